@@ -55,11 +55,23 @@ SOURCES += \
         lvmainwindow.cpp \
         frameview_widget.cpp \
         frameworker.cpp \
+        lvframebuffer.cpp \
+        lvstages.cpp \
+        stagegraph.cpp \
+        workstealpool.cpp \
         qcustomplot.cpp \
         envicamera.cpp \
+        mappedfile.cpp \
+        envidecode.cpp \
         xiocamera.cpp \
+        dirfollower.cpp \
+        simcamera.cpp \
+        shmcamera.cpp \
+        netcamera.cpp \
+        playbackpacer.cpp \
         controlsbox.cpp \
         darksubfilter.cpp \
+        dsfkernels.cpp \
         ctkrangeslider.cpp \
         osutils.cpp \
         stddevfilter.cpp \
@@ -68,7 +80,7 @@ SOURCES += \
         meanfilter.cpp \
         fft_widget.cpp \
         saveserver.cpp \
-        twoscomplimentfilter.cpp \
+        ingestfilter.cpp \
         saveclient.cpp
 exists(EDT_include/edtinc.h):SOURCES += clcamera.cpp
 
@@ -77,16 +89,31 @@ HEADERS += \
         frameview_widget.h \
         image_type.h \
         lvframe.h \
+        lvframebuffer.h \
+        lvstage.h \
+        stagegraph.h \
+        workstealpool.h \
         frameworker.h \
         qcustomplot/qcustomplot.h \
         cameramodel.h \
         envicamera.h \
+        mappedfile.h \
+        envidecode.h \
         constants.h \
         xiocamera.h \
+        dirfollower.h \
+        spscring.h \
+        simcamera.h \
+        shmcamera.h \
+        shmring.h \
+        netcamera.h \
+        netframe.h \
+        playbackpacer.h \
         osutils.h \
         controlsbox.h \
         alphanum.hpp \
         darksubfilter.h \
+        dsfkernels.h \
         ctkrangeslider.h \
         lvtabapplication.h \
         stddevfilter.h \
@@ -100,10 +127,11 @@ HEADERS += \
         saveclient.h \
         dsfprefdialog.h \
         cameraselectdialog.h \
-        twoscomplimentfilter.h \
+        ingestfilter.h \
         cameraviewdialog.h \
         frameratedialog.h \
-    include/interlacefilter.h
+        pipelinestatsdialog.h \
+        ringbufferdialog.h
 exists(EDT_include/edtinc.h):HEADERS += clcamera.h
 
 RESOURCES += \
@@ -116,4 +144,5 @@ DISTFILES += \
 
 macx: LIBS += -framework OpenCL
 else:unix|win32: LIBS += -lOpenCL
+unix:!macx: LIBS += -lrt
 exists(EDT_include/edtinc.h): unix:!macx: LIBS += -L$$PWD/lib -lm -lpdv -ldl
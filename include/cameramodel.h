@@ -15,17 +15,50 @@ class CameraModel : public QObject
     Q_OBJECT
 
 public:
-    CameraModel(QObject *parent = nullptr) : QObject(parent) { running.store(false); }
+    CameraModel(QObject *parent = nullptr) : QObject(parent),
+        play_dir(1), loop_first(0), loop_last(-1), current_frame(-1) { running.store(false); }
     virtual ~CameraModel() { running.store(false); }
 
 
     virtual bool start() { return true; }
     virtual uint16_t *getFrame() = 0;
 
+    /* Frame lease interface. FrameWorker hands the source the next ring slot. A source may
+     * decode straight into the slot and return it, or return a pointer to a buffer that it
+     * owns. Either way the pointer stays valid until releaseFrame() is called with it.
+     * The default implementation wraps getFrame() for sources that have not been ported. */
+    virtual uint16_t *acquireFrame(uint16_t *slot) { Q_UNUSED(slot); return getFrame(); }
+    virtual void releaseFrame(uint16_t *frame) { Q_UNUSED(frame); }
+
+    // Capture time in ns of the frame last returned by acquireFrame() or getFrame(), or -1 if the
+    // source does not know it. Only differences between stamps are meaningful.
+    virtual int64_t frameTimestamp() { return -1; }
+    // frame_status_t bits describing the frame last returned.
+    virtual uint32_t frameStatus() { return 0; }
+
     virtual void setDir(const char *filename) { Q_UNUSED(filename); }
 
+    /* Random access for recorded sources. Frames are numbered from 0 in recording order,
+     * live sources keep these defaults. seek() and setPlayDirection() take effect on the
+     * next acquired frame. While a loop range [first, last] is set, playback wraps around
+     * inside it instead of running off the end. first > last turns looping off. */
+    virtual bool isSeekable() { return false; }
+    virtual int64_t frameCount() { return 0; }
+    virtual bool seek(int64_t frame) { Q_UNUSED(frame); return false; }
+    virtual void setPlayDirection(int dir) { play_dir.store(dir < 0 ? -1 : 1); }
+    int playDirection() const { return play_dir.load(); }
+    void setLoop(int64_t first, int64_t last) { loop_first.store(first); loop_last.store(last); }
+    bool isLooping() const { return loop_first.load() <= loop_last.load(); }
+    // Number of the frame last handed out, or -1 if there is none yet.
+    int64_t currentFrame() const { return current_frame.load(); }
+
     virtual bool isRunning() { return running.load(); }
 
+    // Frames the source knows were lost before they reached LiveView (e.g. frame grabber
+    // overruns), and how many times it timed out waiting for a frame.
+    virtual uint64_t droppedFrames() { return 0; }
+    virtual uint64_t timeoutCount() { return 0; }
+
     int getFrameWidth() const { return frame_width; }
     int getFrameHeight() const { return frame_height; }
     int getDataHeight() const { return data_height; }
@@ -46,6 +79,11 @@ protected:
     source_t source_type;
 
     std::atomic<bool> running;
+
+    std::atomic<int> play_dir; // 1 forward, -1 reverse
+    std::atomic<int64_t> loop_first;
+    std::atomic<int64_t> loop_last;
+    std::atomic<int64_t> current_frame;
 };
 
 #endif // CAMERAMODEL_H
@@ -28,7 +28,10 @@ public:
                             << QString("CL")
 #endif
                             << QString("SSD (ENVI)"))
-                            << QString("SSD (XIO)");
+                            << QString("SSD (XIO)")
+                            << QString("Simulator")
+                            << QString("Shared Memory")
+                            << QString("Network Stream");
 
         cameraListModel = new QStringListModel(this);
         cameraListModel->setStringList(cameraList);
@@ -101,7 +104,9 @@ private slots:
                         Qt::DisplayRole).toString().toStdString()]);
         s->setValue(QString("show_cam_dialog"), doNotShowBox->checkState() == 0);
         if (s->value(QString("cam_model"), "XIO").toInt() == 0 ||
-            s->value(QString("cam_model"), "ENVI").toInt() == 1) {
+            s->value(QString("cam_model"), "ENVI").toInt() == 1 ||
+            s->value(QString("cam_model"), "SIM").toInt() == SIM ||
+            s->value(QString("cam_model"), "NET").toInt() == NET) {
             dim_dialog->exec();
         } else {
             this->accept();
@@ -116,7 +121,7 @@ private slots:
     }
 
 private:
-    std::unordered_map<std::string, source_t> source_t_name{{"SSD (ENVI)", ENVI}, {"SSD (XIO)",XIO}, {"CL", CAMERA_LINK}, {"CAMERA_LINK", CAMERA_LINK}};
+    std::unordered_map<std::string, source_t> source_t_name{{"SSD (ENVI)", ENVI}, {"SSD (XIO)",XIO}, {"CL", CAMERA_LINK}, {"CAMERA_LINK", CAMERA_LINK}, {"Simulator", SIM}, {"Shared Memory", SHM}, {"Network Stream", NET}};
     QSettings *s;
     QStringList cameraList;
     QStringList formatList;
@@ -34,6 +34,15 @@ public:
         case ENVI:
             infoList = "ENVI file reader";
             break;
+        case SIM:
+            infoList = "Synthetic pattern generator";
+            break;
+        case SHM:
+            infoList = "Shared memory ring";
+            break;
+        case NET:
+            infoList = "Network frame stream";
+            break;
         default:
             qDebug("警報：無法辨認照相機型號，請選擇別的照相機型號。");
         }
@@ -2,6 +2,7 @@
 #define EDTCAMERA_H
 
 
+#include <atomic>
 #include <cstring>
 #include <mutex>
 
@@ -20,6 +21,9 @@ public:
     virtual bool start();
     virtual uint16_t* getFrame();
     virtual bool isRunning();
+    virtual uint32_t frameStatus();
+    virtual uint64_t droppedFrames() { return overruns.load(); }
+    virtual uint64_t timeoutCount() { return uint64_t(timeouts.load()); }
 
 private:
     PdvDev* dev_p;
@@ -27,8 +31,10 @@ private:
     int channel;
     int numbufs;
     int frate;
-    int overrun, overruns;
-    int timeouts, last_timeouts;
+    int overrun;
+    std::atomic<uint64_t> overruns;
+    std::atomic<int> timeouts;
+    int last_timeouts;
     bool recovering_timeout;
     std::mutex dev_p_lock;
 };
@@ -6,7 +6,14 @@ static const bool USE_DARK_STYLE = true;
 #else
 static const bool USE_DARK_STYLE = false; //dark style does not display some widgets properly on Linux
 #endif
+// Depth of the raw frame ring until the frame rate is known, after that it follows the rate
+// within the configured memory budget, between RING_MIN_FRAMES and RING_MAX_FRAMES.
 static const unsigned int CPU_FRAME_BUFFER_SIZE = 200;
+static const int RING_MIN_FRAMES = 16;
+static const int RING_MAX_FRAMES = 65535;
+// Depth of the DSF and standard deviation product rings. Readers only ever want the newest
+// products, the extra slots just keep a display copy from being overwritten underneath it.
+static const int PRODUCT_RING_SIZE = 4;
 static const unsigned int MAX_SIZE = 2560*2560;
 static const int MAX_N = 50;
 static const unsigned int GPU_FRAME_BUFFER_SIZE = MAX_N;
@@ -18,6 +25,8 @@ static const long long FRAME_PERIOD_MS = 40;
 // static const unsigned int TARGET_FRAMERATE = 60;
 // static const unsigned int FRAME_DISPLAY_PERIOD_MSECS = 1000 / TARGET_FRAMERATE;
 static const unsigned int FRAME_DISPLAY_PERIOD_MSECS = 25;
+// The processing loops are woken by each new frame, this only bounds how long they sleep without one.
+static const int LOOP_IDLE_TIMEOUT_MS = 250;
 
 static const unsigned int MAX_FFT_SIZE = 4096;
 static const int FFT_INPUT_LENGTH = 512; // Must be 256, will fail silently otherwise
@@ -25,6 +34,13 @@ static const unsigned int FFT_MEAN_BUFFER_LENGTH = 512;
 
 static const int CHUNK_NUMLINES = 32;
 
+// Every source window runs its processing dispatch loop, file reader, save and lossless mask
+// collection jobs on the one global QThreadPool, which grows by this much per source. The
+// processing stages themselves run on one pool that all sources share.
+static const int POOL_THREADS_PER_SOURCE = 4;
+// Lossless mask collection adds up to this many frames at a time.
+static const int MASK_BATCH_FRAMES = 16;
+
 namespace LV {
     enum PlotMode { pmRAW, pmDSF, pmSNR };
 }
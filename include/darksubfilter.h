@@ -2,7 +2,9 @@
 #define DARKSUBFILTER_H
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <mutex>
 #include <stdint.h>
 #include <vector>
@@ -11,6 +13,8 @@
 #include <QString>
 #include <QObject>
 
+#include "dsfkernels.h"
+
 class DarkSubFilter : public QObject
 {
     Q_OBJECT
@@ -23,9 +27,19 @@ public:
     void collect_mask(const uint16_t *in_frame);
     void dark_subtract(const uint16_t *in_frame, float *out_frame);
 
-    void start_mask_collection(const quint64 &avgf);
+    /* With lossless set, dsf_callback() leaves the mask alone and the frames come in through
+     * collect_frames() instead, every one of them in order. */
+    void start_mask_collection(const quint64 &avgf, bool lossless = false);
     void finish_mask_collection();
 
+    bool collecting() const { return !mask_collected.load(); }
+    // How many more frames the mask takes, ULLONG_MAX while it is collected until stopped.
+    quint64 frames_wanted();
+    /* Adds count frames to the mask as one batch. intact is asked after they were read and
+     * before they are added, a batch it refuses is dropped as a whole. Returns whether the
+     * frames went in. */
+    bool collect_frames(const uint16_t *const *frames, size_t count, const std::function<bool()> &intact);
+
     void apply_mask_file(const QString &file_name);
     void save_mask_file(const QString &file_name);
 
@@ -37,14 +51,18 @@ signals:
     void mask_frames_collected();
 
 private:
-    bool mask_collected;
+    std::atomic<bool> mask_collected;
+    std::atomic<bool> collect_in_callback;
     size_t frSize;
     quint64 nSamples;
 
     std::vector<double> mask_accum;
+    std::vector<uint32_t> batch_sum;
     std::vector<float> mask;
 
     quint64 avgd_frames;
+
+    const dsf::kernels_t &simd; // picked once for this CPU
 };
 
 #endif // DARKSUBFILTER_H
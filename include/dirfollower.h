@@ -0,0 +1,55 @@
+#ifndef DIRFOLLOWER_H
+#define DIRFOLLOWER_H
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "alphanum.hpp"
+#include "osutils.h"
+
+/* Keeps an ordered index of the XIO (.xio/.decomp) files in a directory that is
+ * still being written to. The directory is listed once, after which new files
+ * are learned from inotify events (on Linux) and slotted into the index, so
+ * finding the next file never rescans or resorts the directory. */
+class DirFollower
+{
+public:
+    DirFollower();
+    ~DirFollower();
+
+    bool follow(const std::string &directory);
+    void stop();
+
+    // Returns the next unread file in filename order, or false if there is none yet.
+    bool next(std::string &fname);
+    // Random access by position in filename order, false if there is no such file yet.
+    bool at(size_t index, std::string &fname);
+    /* Blocks until the directory may have changed, or until timeout_ms has passed. The
+     * changes are only taken in by next() or at() past the known files, until then this
+     * returns right away. */
+    void wait(int timeout_ms);
+
+    size_t size() const { return files.size(); }
+    size_t position() const { return cursor; }
+
+private:
+    DirFollower(const DirFollower&) = delete;
+    DirFollower& operator=(const DirFollower&) = delete;
+
+    void poll();
+    void rescan();
+    void insert(const std::string &path);
+    static bool accept(const std::string &fname);
+
+    std::string dir;
+    int inotify_fd;
+    int watch_fd;
+
+    std::vector<std::string> files; // read order, sorted by alphanum_less
+    std::unordered_set<std::string> known;
+    size_t cursor;
+    doj::alphanum_less<std::string> less;
+};
+
+#endif // DIRFOLLOWER_H
@@ -0,0 +1,47 @@
+#ifndef DSFKERNELS_H
+#define DSFKERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* The per-pixel loops of DarkSubFilter, in one version per instruction set. Which set runs is
+ * decided once, on first use, from what the CPU supports: AVX-512, AVX2 or SSE4.1 on x86,
+ * NEON on 64-bit ARM, plain C++ everywhere else. Every set gives results bit for bit equal to
+ * the scalar one, and is checked against it before it is picked. */
+namespace dsf
+{
+    struct kernels_t
+    {
+        const char *name;
+        // out = in - mask
+        void (*subtract)(const uint16_t *in, const float *mask, float *out, size_t n);
+        // out = in
+        void (*widen)(const uint16_t *in, float *out, size_t n);
+        // accum += in
+        void (*accumulate)(const uint16_t *in, double *accum, size_t n);
+        // out = accum / samples, divided in double and rounded to float once
+        void (*average)(const double *accum, double samples, float *out, size_t n);
+        /* sum = the sum of count frames, at most 32768 of them so that it fits an int32. Adding
+         * the sum to the accumulator in one go, with add_sums, gives the same result as adding
+         * the frames one by one, since the accumulator only ever holds whole numbers well
+         * below 2^53. It reads the accumulator once per batch instead of once per frame. */
+        void (*sum_frames)(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n);
+        // accum += sum
+        void (*add_sums)(const uint32_t *sum, double *accum, size_t n);
+    };
+
+    // The fastest set that runs here and passed the check.
+    const kernels_t &kernels();
+
+    // Scalar reference versions of the above.
+    const kernels_t &scalar();
+
+    // Every set this CPU can run, fastest first, whether or not it passed the check.
+    std::vector<const kernels_t*> supported();
+
+    // Runs k and the scalar set over the same inputs and compares the results bit for bit.
+    bool matchesScalar(const kernels_t &k);
+}
+
+#endif // DSFKERNELS_H
@@ -20,7 +20,8 @@ class DSFPrefDialog : public QDialog
     Q_OBJECT
 
 public:
-    DSFPrefDialog() : mask_file(""), avgd_frames(1), open_mode(true)
+    explicit DSFPrefDialog(bool lossless = false) :
+        mask_file(""), avgd_frames(1), lossless(lossless), open_mode(true)
     {
         this->setWindowTitle("Set Dark Subtraction Mask Preferences");
         this->setModal(true);
@@ -30,10 +31,12 @@ public:
         connect(openChoice, &QRadioButton::clicked, this, [this]() {
             useFixedFrames->setChecked(false);
             useFixedFrames->setEnabled(false);
+            losslessBox->setEnabled(false);
             open_mode = true;
         });
         connect(saveChoice, &QRadioButton::clicked, this, [this]() {
             useFixedFrames->setEnabled(true);
+            losslessBox->setEnabled(true);
             open_mode = false;
         });
 
@@ -51,6 +54,13 @@ public:
         QHBoxLayout *checkLayout = new QHBoxLayout;
         checkLayout->addWidget(useFixedFrames);
 
+        /* Normally the mask is added up from the frames the dark subtraction display gets to,
+         * which skips frames when it falls behind. In lossless mode every frame from the
+         * moment collection starts goes into the mask, in order, so a fixed number of frames
+         * spans exactly that many frame periods. */
+        losslessBox = new QCheckBox("Collect the mask from every frame, without skipping", this);
+        losslessBox->setChecked(lossless);
+
         /* Controls the number of frames to average each time a
          * dark subtraction mask is requested. The default is to continue
          * to record frames until the user presses a button to stop
@@ -97,6 +107,7 @@ public:
         dialogLayout->addLayout(fileEditLayout);
         dialogLayout->addLayout(checkLayout);
         dialogLayout->addLayout(avgLayout);
+        dialogLayout->addWidget(losslessBox);
         dialogLayout->addLayout(buttonLayout);
 
         openChoice->click();
@@ -104,6 +115,7 @@ public:
 
     const QString& getMaskFile() { return mask_file; }
     const quint64& getAvgdFrames() { return avgd_frames; }
+    bool getLossless() const { return lossless; }
 
 signals:
     void applyMaskFromFile(QString);
@@ -114,6 +126,7 @@ private slots:
     {
         applyMask();
         avgd_frames = useFixedFrames->isChecked() ? static_cast<quint64>(avgdFramesBox->value()) : 0;
+        lossless = losslessBox->isChecked();
         this->accept();
     }
 
@@ -150,9 +163,11 @@ protected slots:
 private:
     QString mask_file;
     quint64 avgd_frames;
+    bool lossless;
     bool open_mode;
     QLineEdit *fileEdit;
     QCheckBox *useFixedFrames;
+    QCheckBox *losslessBox;
     QSpinBox *avgdFramesBox;
     QLabel *maskLabel;
 };
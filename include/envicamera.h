@@ -2,21 +2,18 @@
 #define DEBUGCAMERA_H
 
 #include <array>
-#include <deque>
 #include <fstream>
+#include <mutex>
 #include <vector>
 #include <sstream>
 #include <string>
 
-#include <QtConcurrent/QtConcurrent>
-#include <QCoreApplication>
 #include <QDebug>
-#include <QFuture>
-#include <QTime>
 
 #include "cameramodel.h"
 #include "constants.h"
 #include "lvframe.h"
+#include "mappedfile.h"
 #include "osutils.h"
 
 struct ENVIData {
@@ -24,7 +21,9 @@ struct ENVIData {
     int samples;      // width
     int lines;        // num. frames
     org_t interleave; // bit organization
-    int nbits;        // num. bits/pixel
+    int data_type;    // ENVI data type code, see envi::data_t
+    bool big_endian;  // byte order = 1
+    size_t offset;    // header offset, bytes
 };
 
 class ENVICamera : public CameraModel
@@ -39,29 +38,41 @@ public:
     ~ENVICamera();
 
     virtual uint16_t *getFrame();
+    virtual uint16_t *acquireFrame(uint16_t *slot);
+    virtual void releaseFrame(uint16_t *frame);
     virtual void setDir(const char *filename);
 
+    virtual uint32_t frameStatus() { return no_data ? FRAME_NO_DATA : FRAME_OK; }
+
+    virtual bool isSeekable() { return true; }
+    virtual int64_t frameCount() { return nFrames; }
+    virtual bool seek(int64_t frame);
+    virtual void setPlayDirection(int dir);
+
 private:
     bool readHeader(std::string hdrname);
     ENVIData HDRData;
-    void readLoop();
+    uint16_t *nextFrame(uint16_t *slot);
+    void adviseWindow();
+    void resume();
+    size_t sampleBytes() const;
+    bool needsSwap() const;
+    bool isNative() const; // data can be lent out of the map without conversion
 
-    bool is_reading; // Flag that is true while reading from a directory
-    std::ifstream dev_p;
+    MappedFile data_map;
+    std::mutex map_lock; // held from acquireFrame() to releaseFrame() so setDir() can't unmap a leased frame
     std::string ifname;
     std::string hdrname;
-    std::streampos bufsize;
     const int framesize;
-    std::deque< std::vector<uint16_t> > frame_buf;
     std::vector<uint16_t> dummy;
     std::vector<uint16_t> temp_frame;
-    int curIndex;
+    std::vector<uint16_t> bip_line; // converted BIP line waiting to be transposed
     int nFrames;
-    int chunkFrames; // frames to read per buffered chunk
-    int framesRead;
-
-    QFuture<void> readLoopFuture;
-    int tmoutPeriod;
+    int chunkFrames; // frames per read-ahead/drop-behind window
+    // Every line of an ENVI file sits at a fixed offset, so seeking is only a matter of moving this.
+    int64_t next_frame;
+    int64_t advised_at; // next_frame when adviseWindow() last ran
+    bool no_data; // the last frame handed out was the blank dummy
 };
 
 #endif // DEBUGCAMERA_H
@@ -0,0 +1,41 @@
+#ifndef ENVIDECODE_H
+#define ENVIDECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Helpers to decode ENVI data into the uint16 BIL layout that the rest of LiveView
+ * expects, i.e. one frame of [bands][samples] per ENVI line. */
+namespace envi
+{
+    // ENVI "data type" codes that LiveView can ingest.
+    enum data_t {
+        DT_UINT8 = 1,
+        DT_INT16 = 2,
+        DT_INT32 = 3,
+        DT_FLOAT32 = 4,
+        DT_UINT16 = 12
+    };
+
+    bool isSupported(int data_type);
+    size_t sampleSize(int data_type);
+
+    // Convert n samples of the given ENVI type into the pipeline's uint16 format, swapping
+    // byte order first if the file is big-endian. Signed and floating point input saturates
+    // to [0, 65535], floats are rounded to nearest and NaN maps to 0. src may be unaligned.
+    void convert_to_u16(const unsigned char *src, uint16_t *dst, size_t n,
+                        int data_type, bool swap_bytes);
+
+    // Scalar reference version of the above.
+    void convert_to_u16_scalar(const unsigned char *src, uint16_t *dst, size_t n,
+                               int data_type, bool swap_bytes);
+
+    // Cache-blocked transpose of a rows x cols matrix into cols x rows. Used to turn one
+    // BIP line ([samples][bands]) into a BIL frame. src and dst must not overlap.
+    void transpose_u16(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols);
+
+    // Scalar reference version of the above.
+    void transpose_u16_scalar(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols);
+}
+
+#endif // ENVIDECODE_H
@@ -2,6 +2,7 @@
 #define FRAMERATEDIALOG_H
 
 #include <QBoxLayout>
+#include <QComboBox>
 #include <QDialog>
 #include <QLabel>
 #include <QPushButton>
@@ -13,7 +14,7 @@ class FrameRateDialog : public QDialog
     Q_OBJECT
 
 public:
-    FrameRateDialog(int framerate)
+    FrameRateDialog(int framerate, int mode = 0)
     {
         this->setWindowTitle("Change Playback Framerate");
 
@@ -23,8 +24,21 @@ public:
         connect(cancelButton, &QPushButton::clicked, this, &QDialog::reject);
 
         fpsEdit = new QSpinBox(this);
+        fpsEdit->setMinimum(1);
+        fpsEdit->setMaximum(20000); // periods below 1 ms are paced with absolute deadlines
         fpsEdit->setValue(framerate);
-        fpsEdit->setMaximum(1000);
+
+        // Order matches pace_mode_t
+        modeBox = new QComboBox(this);
+        modeBox->addItem("Fixed framerate");
+        modeBox->addItem("Unthrottled");
+        modeBox->addItem("Original timestamps");
+        modeBox->setCurrentIndex(mode);
+        modeBox->setToolTip("Original timestamps replays frames with their recorded spacing where the "
+                            "source provides it, and falls back to the fixed framerate elsewhere.");
+        connect(modeBox, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+                this, [this](int index) { fpsEdit->setEnabled(index != 1); });
+        fpsEdit->setEnabled(mode != 1);
 
         topLabel = new QLabel(QString("Current target playback framerate: %1 fps").arg(framerate));
 
@@ -34,6 +48,10 @@ public:
         middleRow->addWidget(new QLabel("New Framerate (fps): "));
         middleRow->addWidget(fpsEdit);
         dialogLayout->addLayout(middleRow);
+        QHBoxLayout *modeRow = new QHBoxLayout();
+        modeRow->addWidget(new QLabel("Pacing: "));
+        modeRow->addWidget(modeBox);
+        dialogLayout->addLayout(modeRow);
         QHBoxLayout *bottomButtons = new QHBoxLayout();
         bottomButtons->addWidget(applyButton);
         bottomButtons->addWidget(cancelButton);
@@ -41,15 +59,18 @@ public:
     }
 
     QSpinBox *fpsEdit;
+    QComboBox *modeBox;
     QLabel *topLabel;
 
 signals:
     void framerate_changed(int);
+    void pacing_changed(int);
 
 private slots:
     void applyFramerate() {
         topLabel->setText(QString("Current target playback framerate: %1 fps").arg(fpsEdit->value()));
         emit framerate_changed(fpsEdit->value());
+        emit pacing_changed(modeBox->currentIndex());
         this->accept();
     }
 
@@ -2,6 +2,8 @@
 #define FRAMEWORKER_H
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
 
 #include <QMessageBox>
@@ -18,13 +20,16 @@
 #include "cameramodel.h"
 #include "envicamera.h"
 #include "xiocamera.h"
+#include "simcamera.h"
+#include "shmcamera.h"
+#include "netcamera.h"
+#include "playbackpacer.h"
 
 #ifdef USE_EDT
 #include "clcamera.h"
 #endif
 
-#include "twoscomplimentfilter.h"
-#include "interlacefilter.h"
+#include "ingestfilter.h"
 #include "darksubfilter.h"
 #include "stddevfilter.h"
 #include "meanfilter.h"
@@ -32,8 +37,12 @@
 
 // constexpr int FPS_FRAME_WIDTH = 10;
 constexpr int MAXSAMPLES = 10;
+// Display reads that find their slot rewritten underneath them start over this many times at most.
+constexpr int READ_RETRIES = 4;
 
 class LVFrameBuffer;
+class StageGraph;
+class WorkStealingPool;
 
 using namespace std::chrono;
 
@@ -42,7 +51,9 @@ class FrameWorker : public QObject
     Q_OBJECT
 
 public:
-    explicit FrameWorker(QSettings *settings, QThread *worker, QObject *parent = nullptr);
+    // stage_pool is shared by every source of the process and must outlive this FrameWorker.
+    explicit FrameWorker(QSettings *settings, WorkStealingPool *stage_pool, QThread *worker,
+                         QObject *parent = nullptr);
     ~FrameWorker();
     void stop();
     bool running();
@@ -53,8 +64,7 @@ public:
 
     std::vector<float> getFrame();
 
-    TwosComplimentFilter* TwosFilter;
-    InterlaceFilter* IlaceFilter;
+    IngestFilter* InFilter;
     DarkSubFilter* DSFilter;
     StdDevFilter* STDFilter;
     MeanFilter* MEFilter;
@@ -71,9 +81,10 @@ public:
     void setCenter(double Xcoord, double Ycoord);
     QPointF* getCenter();
     void setPlotMode(LV::PlotMode pm);
+    LV::PlotMode getPlotMode() const { return plotMode; }
     void collectMask();
     void stopCollectingMask();
-    void setMaskSettings(QString mask_name, quint64 avg_frames);
+    void setMaskSettings(QString mask_name, quint64 avg_frames, bool lossless = false);
 
     int getFrameWidth() const { return frWidth; }
     int getFrameHeight() const { return frHeight; }
@@ -82,8 +93,26 @@ public:
 
     uint32_t getStdDevN();
     double getFramePeriod();
+    pace_mode_t getPacingMode();
 
-    inline void compute_snr(LVFrame *new_frame);
+    // Frame accounting per pipeline stage since startup. Ingest counts frames the source lost as skipped.
+    stage_stats_t getStageStats(stage_t stage);
+
+    /* The raw ring is deep enough to hold ring_slack_ms of frames at the measured frame rate,
+     * within ring_budget_mb. The new ring is built aside and swapped in between frames, once
+     * the readers have let go of the old one and no recording is running. */
+    void setRingBudget(int budget_mb, int slack_ms);
+    size_t getRingDepth();
+    size_t getRingBytes();
+
+    // For the processing stages, which bind their products in the ring themselves.
+    LVFrameBuffer *frameBuffer() { return lvframe_buffer; }
+
+    // Metadata of the frame the displays are currently drawing from.
+    LVFrameMeta getFrameMeta();
+    void resetStageStats();
+
+    void compute_snr(LVFrame *new_frame);
 
     volatile bool pixRemap;
     volatile bool is16bit;
@@ -104,19 +133,62 @@ signals:
 public slots:
     void reportTimeout();
     void captureFrames();
-    void captureDSFrames();
-    void captureSDFrames();
+    void processFrames();
     void reportFPS();
     void captureFramesRemote(const save_req_t &new_req);
     void applyMask(const QString &fileName);
     void setStdDevN(int new_N);
     void setFramePeriod(double period);
+    void setPacingMode(int mode);
+    void setPlayback(int dir);
+    void stepFrames(int delta);
+    void seekFrame(qint64 frame);
+    void setLoopRange(qint64 first, qint64 last);
 
 private:
     QThread *thread;
     LVFrameBuffer *lvframe_buffer;
-    void delay(int64_t msecs);
+    PlaybackPacer pacer;
+    std::atomic<bool> paused; // file playback holds the last frame until stepped or resumed
+    std::atomic<int> steps_pending;
+
+    // Pins the calling thread to cpus (if any) and returns the affinity it had, for putting it back.
+    std::vector<int> pinTo(const std::vector<int> &cpus, const char *role);
+    std::vector<int> acquisition_cpus;
+    std::vector<int> processing_cpus;
+    std::vector<int> io_cpus;
+    int ring_node; // NUMA node the ring memory is placed on, -1 for wherever it is first touched
+
+    void buildStages();
+    WorkStealingPool *stage_pool; // not ours
+    StageGraph *stage_graph;
+
+    int ringDepthFor(double frame_rate);
+    void resizeRing();
+    // Whatever reads raw frames outside the capture loop enters the ring first, so that a resize
+    // can wait for it to be idle. enterRing() fails while a resize is waiting to swap rings,
+    // waitRing() sleeps until the resize is through.
+    bool enterRing();
+    void waitRing();
+    void leaveRing();
+    void releaseRing(); // lifts the hold of a resize, and wakes whoever waits on it
+    std::atomic<int> ring_budget_mb;
+    std::atomic<int> ring_slack_ms;
+    std::atomic<int> ring_target; // depth the ring should have
+    std::atomic<bool> ring_hold;
+    std::atomic<int> ring_users;
+    std::mutex ring_lock;
+    std::condition_variable ring_free;
+    std::vector<float> last_raw; // what getFrame() returned last, for while the ring is held
+    QFuture<void> ring_prep; // builds the next ring, or frees the last one
+
+    void countDisplayed(uint64_t seq);
+    std::vector<float> readProduct(bool dsf, float *LVFrame::*plane);
+    std::array<std::atomic<uint64_t>, NUM_STAGES> stage_processed;
+    std::array<std::atomic<uint64_t>, NUM_STAGES> stage_skipped;
+    std::atomic<uint64_t> display_seq; // newest frame drawn so far
     std::vector<uint16_t> (FrameWorker::*p_getSaveFrame)();
+    void writeMeta(std::ofstream &out, uint64_t line, const LVFrameMeta &meta);
     std::vector<uint16_t> getBILSaveFrame();
     std::vector<uint16_t> getBIPSaveFrame();
     void convertBSQ(save_req_t req);
@@ -143,6 +215,11 @@ private:
 
     QString mask_file;
     quint64 avgd_frames;
+    // Lossless collection reads every frame from the ring, on a job of its own.
+    void collectMaskFrames(int64_t first_frame);
+    bool mask_lossless;
+    std::atomic<bool> mask_collecting;
+    QFuture<void> mask_loop;
 
     int tickindex = 0;
     int ticksum = 0;
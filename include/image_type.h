@@ -1,20 +1,41 @@
 #ifndef IMAGE_TYPE_H
 #define IMAGE_TYPE_H
 
+#include <stdint.h>
 #include <unordered_map>
 #include <string>
 
 enum image_t {BASE, DSF, STD_DEV, SPATIAL_PROFILE, SPECTRAL_PROFILE, SPATIAL_MEAN, SPECTRAL_MEAN};
 
-enum camera_t {SSD_ENVI, SSD_XIO, CL_6604A, CL_6604B};
+enum camera_t {SSD_ENVI, SSD_XIO, CL_6604A, CL_6604B, SIM_PATTERN, SHM_RING, NET_STREAM};
 
 enum source_t {
     XIO = 0,
     ENVI = 1,
-    CAMERA_LINK = 2};
+    CAMERA_LINK = 2,
+    SIM = 3,
+    SHM = 4,
+    NET = 5};
 
 enum org_t {fwBIL, fwBIP, fwBSQ};
 
+// Bits of LVFrameMeta::status, as reported by CameraModel::frameStatus()
+enum frame_status_t {
+    FRAME_OK = 0,
+    FRAME_OVERRUN = 1,  // the frame grabber overran its buffers around this frame
+    FRAME_TIMEOUT = 2,  // the source was recovering from a timeout
+    FRAME_NO_DATA = 4   // the source had nothing ready, the frame is blank
+};
+
+// Pipeline stages that keep frame accounting, see FrameWorker::getStageStats()
+enum stage_t {STAGE_INGEST, STAGE_DSF, STAGE_STD, STAGE_SAVE, STAGE_DISPLAY, NUM_STAGES};
+
+struct stage_stats_t
+{
+    uint64_t processed; // frames the stage handled
+    uint64_t skipped;   // frames that went past the stage without being handled
+};
+
 struct save_req_t
 {
     org_t bit_org;
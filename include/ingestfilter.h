@@ -0,0 +1,53 @@
+#ifndef INGESTFILTER_H
+#define INGESTFILTER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <QDebug>
+
+/* Brings a frame from the source's buffer into its ring slot in a single pass. The copy, the
+ * twos-complement remap of 14 or 16 bit data and the column deinterlace are fused, so every
+ * pixel is read once and written once, a vector at a time where SSE2 is available.
+ *
+ * Interlaced sensors read their columns out through several taps, so that a row arrives as
+ * [p0 of tap 0, p0 of tap 1, ..., p1 of tap 0, ...]. Deinterlacing puts each tap's columns
+ * back side by side. A kernel is compiled for each combination of remap and deinterlace at
+ * the configured tap count, and the one for the current settings is picked per frame.
+ *
+ * Only the first num_rows rows are image and get deinterlaced, the header rows below them up
+ * to data_rows are only remapped. */
+class IngestFilter
+{
+public:
+    // taps may be 2, 4 or 8.
+    IngestFilter(size_t num_rows, size_t num_cols, size_t data_rows, int taps = 4);
+
+    /* src may be dst, for sources that decode straight into the slot. Deinterlacing then goes
+     * through one row of scratch. */
+    void apply_filter(const uint16_t *src, uint16_t *dst, bool remap, bool is16bit, bool interlace)
+    {
+        kernels[remap ? (is16bit ? 2 : 1) : 0][interlace ? 1 : 0](src, dst, nRows, nCols, dataRows,
+                                                                    row_scratch.data());
+    }
+
+    // Scalar reference version of the above.
+    void apply_filter_scalar(const uint16_t *src, uint16_t *dst, bool remap, bool is16bit, bool interlace);
+
+    int taps() const { return nTaps; }
+
+private:
+    typedef void (*kernel_t)(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols,
+                             size_t data_rows, uint16_t *scratch);
+
+    template <int Taps> void selectKernels();
+
+    size_t nRows;
+    size_t nCols;
+    size_t dataRows;
+    int nTaps;
+    std::vector<uint16_t> row_scratch;
+    kernel_t kernels[3][2]; // [no remap, 14 bit, 16 bit][straight, deinterlaced]
+};
+
+#endif // INGESTFILTER_H
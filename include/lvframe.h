@@ -1,18 +1,45 @@
 #ifndef LVFRAME_H
 #define LVFRAME_H
 
-#include <errno.h>
-#include <sys/time.h>
-#include <sys/mman.h>
-#include <sys/resource.h>
-
-#include <QtGlobal>
-#include <QDebug>
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
 
 #include "constants.h"
+#include "image_type.h"
+
+static const int META_HEADER_WORDS = 16;
+
+/* Everything known about a frame besides its pixels. It lives next to the pixel planes
+ * in the ring slot, so the DSF, standard deviation and save paths all see the metadata
+ * of exactly the frame they are working on without copying it around. */
+struct LVFrameMeta
+{
+    uint64_t seq;          // same as LVFrame::seq
+    int64_t mono_ns;       // steady clock when the frame was acquired
+    int64_t host_ns;       // wall clock (ns since the epoch) when the frame was acquired
+    int64_t source_ns;     // the source's own capture time, -1 if it has none
+    int64_t source_frame;  // position in a recording, -1 for live sources
+    uint32_t status;       // frame_status_t bits
+    uint16_t header_words; // valid entries in header, 0 without an embedded header row
+    // Leading words of the embedded header row that some cameras (e.g. the 6604A) send
+    // below the image. The full row is still in raw_data.
+    uint16_t header[META_HEADER_WORDS];
+};
 
+/* One slot of the frame ring. The planes belong to the LVFrameBuffer arena the frame was
+ * laid out in, an LVFrame only points into it and never allocates or frees memory itself. */
 struct LVFrame
 {
+    /* 1 for the first frame ingested, 0 while the slot is still empty. It is stored
+     * after meta and the pixels have been written, so it also marks them as complete. */
+    std::atomic<uint64_t> seq;
+    /* Seqlock version of seq, meta and the pixels, odd while the slot is being written.
+     * The writer brackets its writes with beginWrite() and endWrite(). A reader takes
+     * readBegin() before copying anything out and only keeps the copy if readValid() says
+     * the slot was not touched meanwhile. A reader never waits for the writer. */
+    std::atomic<uint32_t> version;
+    LVFrameMeta meta;
     uint16_t *raw_data;
     float *dsf_data;
     float *sdv_data;
@@ -23,56 +50,32 @@ struct LVFrame
     float *frame_fft;
     const int frSize;
 
-    LVFrame(const int frame_width, const int frame_height) : frSize(frame_width * frame_height)
+    LVFrame(const int frame_width, const int frame_height) : seq(0), version(0),
+        raw_data(nullptr), dsf_data(nullptr), sdv_data(nullptr), snr_data(nullptr),
+        hist_data(nullptr), spectral_mean(nullptr), spatial_mean(nullptr), frame_fft(nullptr),
+        frSize(frame_width * frame_height)
     {
-        try {
-            raw_data = new uint16_t[frSize];
-            dsf_data = new float[frSize];
-            sdv_data = new float[frSize];
-            snr_data = new float[frSize];
-            hist_data = new uint32_t[NUMBER_OF_BINS];
-            spectral_mean = new float[frame_height];
-            spatial_mean = new float[frame_width];
-            frame_fft = new float[MAX_FFT_SIZE];
-        } catch (std::bad_alloc&) {
-            qFatal("Not enough memory to allocate frame buffer.");
-        }
-        rlimit cur_lims;
-        checkError(getrlimit(RLIMIT_MEMLOCK, &cur_lims));
-        if (cur_lims.rlim_cur != RLIM_INFINITY) {
-            rlimit new_limit = { RLIM_INFINITY, RLIM_INFINITY };
-            checkError(setrlimit(RLIMIT_MEMLOCK, &new_limit));
-        }
- //       checkError(mlock(raw_data, frSize * sizeof(uint16_t)));
-        checkError(mlock(sdv_data, size_t(frSize) * sizeof(float)));
+        memset(&meta, 0, sizeof(meta));
     }
-    ~LVFrame()
+
+    // Only ever called by the one thread that owns the slot for writing.
+    inline void beginWrite()
     {
-//        checkError(munlock(raw_data, frSize * sizeof(uint16_t)));
-        checkError(munlock(sdv_data, size_t(frSize) * sizeof(float)));
-        delete dsf_data;
-        delete sdv_data;
-        delete snr_data;
-        delete hist_data;
-        delete spectral_mean;
-        delete spatial_mean;
-        delete frame_fft;
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
     }
-
-    void checkError(int error)
+    inline void endWrite()
+    {
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    inline uint32_t readBegin() const
+    {
+        return version.load(std::memory_order_acquire);
+    }
+    inline bool readValid(uint32_t begin) const
     {
-        char buffer[256];
-        if (error == -1) {
-#if (__APPLE__ && __MACH__)
-        int res;
-        res = strerror_r(errno, buffer, 256);
-        qWarning("[Errno %d]: %s: %d", errno, buffer, res);
-#else
-        char* err;
-        err = strerror_r(errno, buffer, 256);
-        qWarning("[Errno %d]: %s", errno, err);
-#endif
-        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return !(begin & 1) && version.load(std::memory_order_relaxed) == begin;
     }
 };
 
@@ -0,0 +1,173 @@
+#ifndef LVFRAMEBUFFER_H
+#define LVFRAMEBUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "lvframe.h"
+
+/* The ring of frames that FrameWorker ingests into and the DSF, standard deviation, save and
+ * display paths read from.
+ *
+ * Only the raw frames are kept deep. What the DSF and standard deviation stages derive from
+ * them goes into two small product rings of their own, which are only mapped once their stage
+ * first binds a slot, so a stage that never runs costs no memory. A product slot is an
+ * LVFrame whose raw_data and meta are those of the raw frame it was computed from.
+ *
+ * Each ring lives in one arena, mapped in one go (on 2 MB huge pages when the system has
+ * them) and locked into RAM with a single mlock(). Within an arena each kind of plane forms
+ * its own run, all raw frames back to back, then all DSF frames and so on, so a consumer
+ * walking a ring through one plane streams through memory in order. Every plane starts on
+ * a cache line. */
+class LVFrameBuffer
+{
+public:
+    // With numa_node >= 0 every arena is placed on that node, whichever thread touches it first.
+    LVFrameBuffer(const int num_frames, const int frame_width, const int frame_height,
+                  const int product_frames = PRODUCT_RING_SIZE, const int numa_node = -1);
+    ~LVFrameBuffer();
+
+    /* Lays the rings out again for a new geometry or depth. An arena is only remapped if the
+     * new layout does not fit or would leave most of it unused, otherwise this costs no more
+     * than rebuilding the frame headers. Readers see blank products until the stages publish
+     * again. No other thread may be using the raw frames meanwhile. When only the depth
+     * changes, the product rings are left alone and can still be read during the reset. */
+    void reset(const int num_frames, const int frame_width, const int frame_height);
+
+    /* Changes only the depth, in steps that keep the capture thread from waiting on the new
+     * arena being mapped and locked. prepareDepth() builds the new raw ring aside, from any
+     * thread, while the old one stays in use. adoptDepth() swaps it in for a few pointers,
+     * under the same conditions as reset(), and returns false if nothing was prepared for
+     * the current geometry. The ring it replaces is kept until releaseRetired(), which may
+     * again run on any thread. Both rings are held in memory in between. */
+    void prepareDepth(const int num_frames);
+    int preparedDepth(); // 0 while nothing is prepared
+    bool adoptDepth();
+    void releaseRetired();
+
+    size_t size() const { return frame_vec.size(); }
+    size_t arenaBytes() const { return raw_arena.size + dsf_ring.arena.size + std_ring.arena.size; }
+    bool hugePages() const { return raw_arena.huge_pages; }
+
+    LVFrame* frame(uint16_t i) { return frame_vec.at(i); }
+    LVFrame* current() { return frame_vec.at(uint32_t(fbIndex.load())); }
+    LVFrame* recent() { return frame_vec.at(uint32_t(lastIndex.load())); }
+
+    // The newest published products. Until there are any, these return a frame of zeros.
+    LVFrame* lastDSF() { return published(dsf_ring, dsfIndex); }
+    LVFrame* lastSTD() { return published(std_ring, stdIndex); }
+
+    /* Hands the DSF or standard deviation stage the product slot to fill next, already
+     * pointing at raw frame raw_index. The slot becomes visible to readers with setDSF() or
+     * setSTD(), which refuse and return false if the raw frame was overwritten in the
+     * meantime. Binding again without publishing reuses the slot. The DSF slot reads its SNR
+     * plane from the newest standard deviation products and vice versa. */
+    LVFrame* bindDSF(uint16_t raw_index);
+    LVFrame* bindSTD(uint16_t raw_index);
+
+    std::atomic<int> lastIndex;
+    std::atomic<int> fbIndex;
+    std::atomic<int> dsfIndex; // into the DSF product ring, -1 before the first
+    std::atomic<int> stdIndex; // into the standard deviation product ring, -1 before the first
+
+    inline void incIndex()
+    {
+        lastIndex.store(fbIndex, std::memory_order_release);
+        if (++fbIndex == static_cast<int>(frame_vec.size())) {
+            fbIndex.store(0, std::memory_order_release);
+        }
+        arrivals++;
+        // Only pay for the lock when a loop is actually asleep.
+        if (waiters.load() > 0) {
+            wakeAll();
+        }
+    }
+
+    /* Frames ingested so far. A loop that notes this before looking for work and finds none
+     * passes it to waitForFrame(), which returns as soon as a frame arrives after that point,
+     * or after timeout. */
+    uint64_t arrivalCount() const { return arrivals.load(); }
+    void waitForFrame(uint64_t seen, std::chrono::milliseconds timeout)
+    {
+        waiters++;
+        {
+            std::unique_lock<std::mutex> lock(wake_lock);
+            frame_arrived.wait_for(lock, timeout, [&]() { return arrivals.load() != seen; });
+        }
+        waiters--;
+    }
+    // Also wakes the loops for shutting down.
+    void wakeAll()
+    {
+        std::lock_guard<std::mutex> lock(wake_lock);
+        frame_arrived.notify_all();
+    }
+    bool setDSF() { return publish(dsf_ring, dsfIndex); }
+    bool setSTD() { return publish(std_ring, stdIndex); }
+
+    // The raw slot frame number seq went into, whether or not it still holds it. FrameWorker
+    // keeps frame n in slot (n - 1) % size(), also across resets.
+    LVFrame* slotOf(uint64_t seq) { return frame_vec.at(size_t((seq - 1) % frame_vec.size())); }
+
+private:
+    LVFrameBuffer(const LVFrameBuffer&) = delete;
+    LVFrameBuffer& operator=(const LVFrameBuffer&) = delete;
+
+    struct arena_t
+    {
+        unsigned char *base;
+        size_t size;
+        bool huge_pages;
+        bool locked;
+    };
+
+    enum product_t {PRODUCT_DSF, PRODUCT_STD};
+
+    struct product_ring_t
+    {
+        product_t kind;
+        arena_t arena;
+        std::vector<LVFrame*> frames;
+        int next; // slot handed out by the last bind
+        LVFrame *source; // raw frame of the last bind
+        uint32_t source_version;
+    };
+
+    void layout(const int num_frames, const int frame_width, const int frame_height);
+    void layoutProducts(product_ring_t &ring);
+    LVFrame* bind(product_ring_t &ring, uint16_t raw_index);
+    LVFrame* published(product_ring_t &ring, std::atomic<int> &index);
+    bool publish(product_ring_t &ring, std::atomic<int> &index);
+    void mapArena(arena_t &arena, size_t bytes, const char *what);
+    static void unmapArena(arena_t &arena);
+    static void clearFrames(std::vector<LVFrame*> &frames);
+
+    int width;
+    int height;
+    int product_depth;
+    int numa_node;
+    std::vector<LVFrame*> frame_vec;
+    // Raw rings on their way in and out, see prepareDepth().
+    std::mutex spare_lock;
+    arena_t spare_arena;
+    std::vector<LVFrame*> spare_frames;
+    int spare_width;
+    int spare_height;
+    arena_t retired_arena;
+    std::vector<LVFrame*> retired_frames;
+    std::atomic<uint64_t> arrivals;
+    std::atomic<int> waiters;
+    std::mutex wake_lock;
+    std::condition_variable frame_arrived;
+    arena_t raw_arena;
+    arena_t blank_arena;
+    LVFrame *blank; // all zeros, what readers see before the first products
+    product_ring_t dsf_ring;
+    product_ring_t std_ring;
+};
+
+#endif // LVFRAMEBUFFER_H
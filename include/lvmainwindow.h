@@ -21,6 +21,10 @@
 #include "computedevdialog.h"
 #include "dsfprefdialog.h"
 #include "frameratedialog.h"
+#include "pipelinestatsdialog.h"
+#include "ringbufferdialog.h"
+
+class WorkStealingPool;
 
 class LVMainWindow : public QMainWindow
 {
@@ -28,12 +32,17 @@ class LVMainWindow : public QMainWindow
   //  setAcceptDrops(true);
 
 public:
-    LVMainWindow(QSettings *settings, QWidget *parent = nullptr);
+    // settings is scoped to this source, source_index numbers the windows of one process from 0.
+    // stage_pool runs the processing stages of every source.
+    LVMainWindow(QSettings *settings, WorkStealingPool *stage_pool, int source_index = 0,
+                 QWidget *parent = nullptr);
     ~LVMainWindow() override;
     bool notInitialized;
 
 signals:
     void saveRequest();
+    void addSourceRequested();
+    void quitRequested();
 
 protected:
 #ifndef QT_NO_CONTEXTMENU
@@ -54,11 +63,14 @@ private:
     QMenu *gradientSubMenu;
     QMenu *inversionSubMenu;
     QMenu *formatSubMenu;
+    QMenu *playbackMenu;
     QMenu *aboutMenu;
     QAction *openAct;
     QAction *saveAct;
     QAction *saveAsAct;
     QAction *resetAct;
+    QAction *addSourceAct;
+    QAction *closeSourceAct;
     QAction *exitAct;
     QAction *compAct;
     QAction *dsfAct;
@@ -67,6 +79,17 @@ private:
     QAction *noRemapAct;
     QAction *ilaceAct;
     QAction *fpsAct;
+    QAction *ringAct;
+
+    QActionGroup *playActGroup;
+    QAction *playAct;
+    QAction *reverseAct;
+    QAction *pauseAct;
+    QAction *stepFwdAct;
+    QAction *stepBackAct;
+    QAction *gotoAct;
+    QAction *loopAct;
+    QAction *noLoopAct;
 
     QAction *darkModeAct;
     QAction *modelSelectAct;
@@ -78,12 +101,12 @@ private:
     QAction *BIPact;
     QAction *BSQact;
 
+    QAction *statsAct;
     QAction *camViewAct;
     QAction *helpInfoAct;
 
     FrameWorker *fw;
-    QFuture<void> DSLoop;
-    QFuture<void> SDLoop;
+    QFuture<void> ProcLoop;
     QTabWidget *tab_widget;
     frameview_widget *raw_display;
     frameview_widget *dsf_display;
@@ -100,19 +123,24 @@ private:
 
     ComputeDevDialog *compDialog;
     FrameRateDialog *fpsDialog;
+    RingBufferDialog *ringDialog;
     DSFPrefDialog *dsfDialog;
     CameraViewDialog *camDialog;
+    PipelineStatsDialog *statsDialog;
 
     QString default_dir;
     QString source_dir;
     QSettings *settings;
     source_t source_type;
+    int source_index;
 
 private slots:
     void open();
     void save();
     void saveAs();
     void reset();
+    void goto_frame();
+    void set_loop_range();
     void change_compute_device(const QString &dev_name);
     void show_about_window();
 };
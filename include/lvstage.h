@@ -0,0 +1,86 @@
+#ifndef LVSTAGE_H
+#define LVSTAGE_H
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lvframe.h"
+
+class FrameWorker;
+
+/* What a stage sees of the frame it is run on: the raw slot it is in, and the products of
+ * the stages it named as inputs, in the same order. */
+class StageContext
+{
+public:
+    StageContext(uint64_t seq, uint16_t raw_index, LVFrame **products,
+                 const std::vector<int> &inputs, int self) :
+        frame_seq(seq), raw(raw_index), products(products), inputs(inputs), self(self)
+    {}
+
+    uint64_t seq() const { return frame_seq; }
+    uint16_t rawIndex() const { return raw; }
+
+    // nullptr if input k produced nothing for this frame.
+    LVFrame *input(size_t k) const { return products[inputs.at(k)]; }
+
+    // The frame this stage produced, for the stages reading from it.
+    void setOutput(LVFrame *product) { products[self] = product; }
+    LVFrame *output() const { return products[self]; }
+
+private:
+    const uint64_t frame_seq;
+    const uint16_t raw;
+    LVFrame **products;
+    const std::vector<int> &inputs;
+    const int self;
+};
+
+/* One step of the per-frame processing, run by StageGraph on the processing threads.
+ *
+ * A stage is never run on two frames at once. While it or any stage reading its output is
+ * still busy with one frame, newer frames go past it, and past the stages depending on it,
+ * as skipped. Stages that do not depend on each other run side by side. */
+class LVStage
+{
+public:
+    virtual ~LVStage() {}
+
+    // Names of the stages whose products this one reads. Empty for stages reading the raw frame.
+    virtual std::vector<std::string> inputs() const { return std::vector<std::string>(); }
+
+    // Returning false marks the frame as skipped here, and the stages depending on it skip it too.
+    virtual bool process(StageContext &ctx) = 0;
+
+    /* Called once process() succeeded and every stage reading the output is done with it,
+     * which is where a product gets published. Returning false counts the frame as skipped. */
+    virtual bool finish(StageContext &ctx) { (void)ctx; return true; }
+};
+
+/* Where stages announce themselves, so that FrameWorker can build its graph from the
+ * "stages" setting without knowing them. A stage registers with LV_REGISTER_STAGE in its
+ * own translation unit. */
+class StageRegistry
+{
+public:
+    typedef std::function<LVStage*(FrameWorker*)> factory_t;
+
+    static StageRegistry &instance();
+
+    bool add(const std::string &name, factory_t factory);
+    // nullptr for a name nobody registered.
+    LVStage *create(const std::string &name, FrameWorker *fw) const;
+    std::vector<std::string> names() const;
+
+private:
+    std::map<std::string, factory_t> factories;
+};
+
+#define LV_REGISTER_STAGE(name, type) \
+    static const bool type##_registered = StageRegistry::instance().add(name, \
+        [](FrameWorker *fw) -> LVStage* { return new type(fw); })
+
+#endif // LVSTAGE_H
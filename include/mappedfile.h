@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stdint.h>
+#include <string>
+
+/* Read-only memory map of a whole file, with helpers to steer the kernel's
+ * page cache for streaming access: read ahead of the cursor and drop the pages
+ * behind it, so that very large files can be played back without filling RAM. */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string &fname);
+    void close();
+
+    bool isOpen() const { return addr != nullptr; }
+    const unsigned char *data() const { return addr; }
+    size_t size() const { return length; }
+
+    void adviseSequential();
+    void willNeed(size_t offset, size_t len);
+    void dontNeed(size_t offset, size_t len);
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    int fd;
+    unsigned char *addr;
+    size_t length;
+    size_t page_size;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,114 @@
+#ifndef NETCAMERA_H
+#define NETCAMERA_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <QDebug>
+
+#include "cameramodel.h"
+#include "netframe.h"
+
+enum net_proto_t {NET_UDP = 0, NET_TCP = 1};
+
+/* Live source that receives frames from a remote acquisition node over the network, in
+ * the format described in netframe.h. LiveView is the listening side: it binds the port
+ * and the sender pushes frames to it, over UDP or over one TCP connection at a time.
+ *
+ * A receiver thread reassembles frames into a fixed pool of frame buffers that is
+ * allocated up front. Datagrams are read in batches with recvmmsg() where available.
+ * Finished frames are lent to FrameWorker in sequence order straight out of the pool.
+ * The receiver never waits for the display: when the pool is full it recycles the
+ * oldest frame that is not lent out. Frames missing from the sequence, whether lost on
+ * the wire, left incomplete or recycled, are counted as dropped. */
+class NetCamera : public CameraModel
+{
+    Q_OBJECT
+
+public:
+    NetCamera(int frWidth = 640,
+              int frHeight = 480,
+              int dataHeight = 480,
+              net_proto_t proto = NET_UDP,
+              const std::string &bind_addr = "0.0.0.0",
+              int port = 50010,
+              int pool_frames = 8,
+              int rcvbuf_mb = 32,
+              int timeout_ms = 1000,
+              QObject *parent = nullptr);
+    ~NetCamera();
+
+    virtual bool start();
+    virtual uint16_t *getFrame();
+    virtual uint16_t *acquireFrame(uint16_t *slot);
+    virtual void releaseFrame(uint16_t *frame);
+
+    virtual int64_t frameTimestamp() { return last_stamp; }
+    virtual uint32_t frameStatus() { return no_data ? FRAME_NO_DATA : FRAME_OK; }
+    virtual uint64_t droppedFrames() { return dropped.load(); }
+    virtual uint64_t timeoutCount() { return timeouts.load(); }
+
+private:
+    enum entry_state_t {ENTRY_FREE, ENTRY_FILLING, ENTRY_READY, ENTRY_LEASED};
+
+    struct pool_entry_t
+    {
+        entry_state_t state;
+        uint64_t seq;
+        int64_t timestamp_ns;
+        uint32_t frags_seen;
+        uint32_t frag_count;
+        std::vector<uint64_t> frag_bits; // one bit per fragment already copied in
+        std::chrono::steady_clock::time_point first_seen;
+        std::vector<uint16_t> frame;
+    };
+
+    bool openSocket();
+    void closeSockets();
+    void udpLoop();
+    void tcpLoop();
+    bool readFully(int fd, void *buf, size_t len);
+    void handleFragment(const unsigned char *data, size_t len);
+    pool_entry_t *claimEntry(uint64_t seq);
+    pool_entry_t *nextDeliverable();
+    static bool recycleBefore(const pool_entry_t &a, const pool_entry_t &b);
+    void publish(pool_entry_t *entry);
+
+    const size_t frSize;
+    const net_proto_t proto;
+    const std::string bind_addr;
+    const int port;
+    const int rcvbuf_bytes;
+    const std::chrono::milliseconds tmoutPeriod;
+
+    int sock_fd;
+    std::atomic<int> conn_fd;
+    std::thread receiver;
+    std::atomic<bool> stopping;
+
+    // Everything below is shared with the receiver thread and guarded by pool_lock.
+    std::mutex pool_lock;
+    std::condition_variable frame_ready;
+    std::vector<pool_entry_t> pool;
+    uint64_t delivered_seq; // last frame handed to FrameWorker, 0 before the first
+    bool warned_geometry;
+
+    pool_entry_t *leased;
+    int64_t last_stamp;
+    bool no_data;
+    std::chrono::steady_clock::time_point last_arrival;
+
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> timeouts;
+
+    std::vector<uint16_t> dummy;
+    std::vector<uint16_t> temp_frame;
+};
+
+#endif // NETCAMERA_H
@@ -0,0 +1,55 @@
+#ifndef NETFRAME_H
+#define NETFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wire format of the frame streams that NetCamera receives. Like shmring.h this header
+ * has no Qt dependencies so that senders can use it as is, see util/net_sender.cpp.
+ * All fields are in the sender's native byte order, the magic tells a receiver of the
+ * other endianness that it cannot use the stream. Pixels are uint16 BIL, width *
+ * data_height samples per frame, the same as every other source.
+ *
+ * TCP: each frame is a frame_header_t followed by payload_bytes of pixels.
+ * UDP: each frame is split into frag_count datagrams, each a fragment_header_t followed
+ * by the bytes at [offset, offset + datagram length - header) of the frame. Fragments
+ * may arrive in any order, seq increases by one per frame so that gaps show up as loss. */
+namespace netframe
+{
+    static const uint32_t MAGIC = 0x464E564C; // "LVNF" in memory
+    static const uint32_t VERSION = 1;
+    static const size_t MAX_DATAGRAM = 65507; // largest UDP payload over IPv4
+
+    struct frame_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t seq;
+        int64_t timestamp_ns; // sender's capture time, -1 if it has none
+        uint32_t width;
+        uint32_t data_height;
+        uint64_t payload_bytes;
+    };
+
+    struct fragment_header_t
+    {
+        uint32_t magic;
+        uint32_t frame_bytes;
+        uint64_t seq;
+        int64_t timestamp_ns;
+        uint32_t offset;
+        uint16_t frag_index;
+        uint16_t frag_count;
+    };
+
+    static_assert(sizeof(frame_header_t) == 40, "frame_header_t must not have padding");
+    static_assert(sizeof(fragment_header_t) == 32, "fragment_header_t must not have padding");
+
+    // Number of datagrams a frame of frame_bytes is sent in with payload bytes per datagram.
+    inline uint32_t fragmentCount(size_t frame_bytes, size_t payload)
+    {
+        return uint32_t((frame_bytes + payload - 1) / payload);
+    }
+}
+
+#endif // NETFRAME_H
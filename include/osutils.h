@@ -13,6 +13,16 @@ namespace os
     void listdir(std::vector<std::string> &out, const std::string &directory);
     std::string getext(const std::string &f);
     std::string trim(const std::string &value);
+
+    // CPU numbers in a list like "0-3,8,10-11", the format of /sys and taskset.
+    std::vector<int> parseCpuList(const std::string &list);
+    // Restricts the calling thread to cpus. The affinity it had before goes into previous,
+    // if given. Does nothing and returns false where that is not supported.
+    bool pinThread(const std::vector<int> &cpus, std::vector<int> *previous = nullptr);
+    // The NUMA node cpu belongs to, -1 if the system does not say.
+    int cpuNode(int cpu);
+    // Asks the kernel to place the pages of [addr, addr + len) on node, before they are touched.
+    bool bindToNode(void *addr, size_t len, int node);
 }
 
 
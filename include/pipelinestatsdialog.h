@@ -0,0 +1,95 @@
+#ifndef PIPELINESTATSDIALOG_H
+#define PIPELINESTATSDIALOG_H
+
+#include <QDialog>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include "frameworker.h"
+
+/* Live view of FrameWorker's per-stage frame accounting, so a lost frame can be pinned
+ * on the grabber, the processing loops, the recorder or the display. */
+class PipelineStatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    PipelineStatsDialog(FrameWorker *fw) : frame_handler(fw)
+    {
+        this->setWindowTitle("Pipeline Statistics");
+
+        const QStringList stages = {"Ingest", "Dark Subtraction / Mean", "Standard Deviation",
+                                    "Recorder", "Display"};
+        table = new QTableWidget(NUM_STAGES, 3, this);
+        table->setHorizontalHeaderLabels({"Processed", "Skipped", "Skipped (%)"});
+        table->setVerticalHeaderLabels(stages);
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+        for (int r = 0; r < NUM_STAGES; r++) {
+            for (int c = 0; c < 3; c++) {
+                table->setItem(r, c, new QTableWidgetItem());
+                table->item(r, c)->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            }
+        }
+        timeoutLabel = new QLabel(this);
+
+        QPushButton *resetButton = new QPushButton("&Reset", this);
+        connect(resetButton, &QPushButton::clicked, this, [this]() {
+            frame_handler->resetStageStats();
+            refresh();
+        });
+        QPushButton *closeButton = new QPushButton("&Close", this);
+        connect(closeButton, &QPushButton::clicked, this, &QDialog::accept);
+
+        QVBoxLayout *dialogLayout = new QVBoxLayout(this);
+        dialogLayout->addWidget(new QLabel("Ingest skips are frames the source reported lost. "
+                                           "Later stages skip frames when they fall behind the newest one."));
+        dialogLayout->addWidget(table);
+        dialogLayout->addWidget(timeoutLabel);
+        QHBoxLayout *bottomButtons = new QHBoxLayout();
+        bottomButtons->addWidget(resetButton);
+        bottomButtons->addWidget(closeButton);
+        dialogLayout->addLayout(bottomButtons);
+
+        connect(&refreshTimer, &QTimer::timeout, this, &PipelineStatsDialog::refresh);
+    }
+
+protected:
+    void showEvent(QShowEvent *event) override
+    {
+        refresh();
+        refreshTimer.start(500);
+        QDialog::showEvent(event);
+    }
+    void hideEvent(QHideEvent *event) override
+    {
+        refreshTimer.stop();
+        QDialog::hideEvent(event);
+    }
+
+private slots:
+    void refresh()
+    {
+        for (int r = 0; r < NUM_STAGES; r++) {
+            stage_stats_t stats = frame_handler->getStageStats(static_cast<stage_t>(r));
+            const uint64_t total = stats.processed + stats.skipped;
+            table->item(r, 0)->setText(QString::number(stats.processed));
+            table->item(r, 1)->setText(QString::number(stats.skipped));
+            table->item(r, 2)->setText(total ? QString::number(100.0 * double(stats.skipped) / double(total), 'f', 2)
+                                             : QString("-"));
+        }
+        timeoutLabel->setText(QString("Source timeouts: %1").arg(frame_handler->Camera->timeoutCount()));
+    }
+
+private:
+    FrameWorker *frame_handler;
+    QTableWidget *table;
+    QLabel *timeoutLabel;
+    QTimer refreshTimer;
+};
+
+#endif // PIPELINESTATSDIALOG_H
@@ -0,0 +1,57 @@
+#ifndef PLAYBACKPACER_H
+#define PLAYBACKPACER_H
+
+#include <stdint.h>
+#include <atomic>
+
+enum pace_mode_t {PACE_FIXED = 0, PACE_UNTHROTTLED = 1, PACE_TIMESTAMPS = 2};
+
+/* Paces file playback against absolute deadlines on the monotonic clock. Each
+ * frame's deadline is derived from the previous deadline rather than from the
+ * time the frame was actually handed over, so the time spent reading and
+ * filtering is absorbed and sleeping late never accumulates into drift.
+ *
+ * PACE_FIXED releases one frame per period, PACE_UNTHROTTLED never waits, and
+ * PACE_TIMESTAMPS reproduces the spacing of the source's own timestamps, using
+ * the fixed period for any frame that has none. If playback falls more than
+ * RESYNC_NS behind (e.g. the reader stalled), the schedule is restarted from
+ * now instead of bursting frames to catch up. */
+class PlaybackPacer
+{
+public:
+    PlaybackPacer();
+
+    void setMode(pace_mode_t new_mode);
+    pace_mode_t getMode() const { return mode.load(); }
+    void setPeriod(double period_ms);
+    double getPeriod() const { return double(period_ns.load()) / 1e6; }
+
+    // Restarts the schedule, the next frame is released immediately.
+    void reset();
+
+    // Blocks until the frame with source timestamp frame_ns (-1 if unknown) is due.
+    void wait(int64_t frame_ns = -1);
+
+    // Frames that were released behind schedule since the last reset.
+    uint64_t lateFrames() const { return late_frames; }
+
+    static int64_t now();
+
+private:
+    static const int64_t RESYNC_NS = 100000000; // 100 ms
+
+    void sleepUntil(int64_t deadline_ns);
+
+    std::atomic<pace_mode_t> mode;
+    std::atomic<int64_t> period_ns;
+    std::atomic<bool> restart;
+
+    // Only touched by the thread calling wait()
+    int64_t deadline;
+    int64_t anchor_wall;
+    int64_t anchor_frame;
+    int64_t last_frame;
+    uint64_t late_frames;
+};
+
+#endif // PLAYBACKPACER_H
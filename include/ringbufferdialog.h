@@ -0,0 +1,82 @@
+#ifndef RINGBUFFERDIALOG_H
+#define RINGBUFFERDIALOG_H
+
+#include <QBoxLayout>
+#include <QDialog>
+#include <QLabel>
+#include <QPushButton>
+#include <QSpinBox>
+
+#include "frameworker.h"
+
+/* Sets how much memory the frame ring may take and how many milliseconds of frames it should
+ * hold for the recorder. The ring follows the measured frame rate within these limits. */
+class RingBufferDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    RingBufferDialog(FrameWorker *fw, int budget_mb, int slack_ms) : frame_handler(fw)
+    {
+        this->setWindowTitle("Frame Buffer");
+
+        QPushButton *applyButton = new QPushButton("&Apply", this);
+        connect(applyButton, &QPushButton::clicked, this, &RingBufferDialog::applyBudget);
+        QPushButton *cancelButton = new QPushButton("&Cancel", this);
+        connect(cancelButton, &QPushButton::clicked, this, &QDialog::reject);
+
+        budgetEdit = new QSpinBox(this);
+        budgetEdit->setRange(16, 1024 * 1024);
+        budgetEdit->setSuffix(" MB");
+        budgetEdit->setValue(budget_mb);
+
+        slackEdit = new QSpinBox(this);
+        slackEdit->setRange(10, 600000);
+        slackEdit->setSuffix(" ms");
+        slackEdit->setValue(slack_ms);
+        slackEdit->setToolTip("How far the recorder may fall behind the camera before it loses frames.");
+
+        depthLabel = new QLabel(this);
+
+        QVBoxLayout *dialogLayout = new QVBoxLayout(this);
+        dialogLayout->addWidget(depthLabel);
+        QHBoxLayout *budgetRow = new QHBoxLayout();
+        budgetRow->addWidget(new QLabel("Memory budget: "));
+        budgetRow->addWidget(budgetEdit);
+        dialogLayout->addLayout(budgetRow);
+        QHBoxLayout *slackRow = new QHBoxLayout();
+        slackRow->addWidget(new QLabel("Buffered time: "));
+        slackRow->addWidget(slackEdit);
+        dialogLayout->addLayout(slackRow);
+        QHBoxLayout *bottomButtons = new QHBoxLayout();
+        bottomButtons->addWidget(applyButton);
+        bottomButtons->addWidget(cancelButton);
+        dialogLayout->addLayout(bottomButtons);
+    }
+
+signals:
+    void budget_changed(int budget_mb, int slack_ms);
+
+protected:
+    void showEvent(QShowEvent *event) override
+    {
+        depthLabel->setText(QString("Current depth: %1 frames, %2 MB")
+                            .arg(frame_handler->getRingDepth())
+                            .arg(frame_handler->getRingBytes() >> 20));
+        QDialog::showEvent(event);
+    }
+
+private slots:
+    void applyBudget() {
+        emit budget_changed(budgetEdit->value(), slackEdit->value());
+        this->accept();
+    }
+
+private:
+    FrameWorker *frame_handler;
+    QSpinBox *budgetEdit;
+    QSpinBox *slackEdit;
+    QLabel *depthLabel;
+};
+
+#endif // RINGBUFFERDIALOG_H
@@ -15,7 +15,7 @@ class SaveServer : public QObject
     Q_OBJECT
 
 public:
-    explicit SaveServer(QObject *parent = nullptr);
+    explicit SaveServer(quint16 listen_port = 50000, QObject *parent = nullptr);
     ~SaveServer();
 
     QHostAddress ipAdress;
@@ -0,0 +1,72 @@
+#ifndef SHMCAMERA_H
+#define SHMCAMERA_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <QDebug>
+
+#include "cameramodel.h"
+#include "shmring.h"
+
+/* Live source that reads frames from a POSIX shared-memory ring filled by a separate
+ * acquisition process (layout in shmring.h). Frames are lent to FrameWorker straight out
+ * of the mapping, so the only copy is the one into LiveView's own frame buffer.
+ *
+ * The producer never waits for us. If it laps the reader, the overwritten frames are
+ * counted as dropped and reading resumes at the newest frame. A frame that is
+ * overwritten while FrameWorker copies it is passed on flagged FRAME_OVERRUN. */
+class ShmCamera : public CameraModel
+{
+    Q_OBJECT
+
+public:
+    ShmCamera(const std::string &ring_name = "/liveview_ring",
+              int timeout_ms = 1000,
+              QObject *parent = nullptr);
+    ~ShmCamera();
+
+    virtual bool start();
+    virtual uint16_t *getFrame();
+    virtual uint16_t *acquireFrame(uint16_t *slot);
+    virtual void releaseFrame(uint16_t *frame);
+
+    virtual int64_t frameTimestamp() { return last_stamp; }
+    virtual uint32_t frameStatus() { return status; }
+    virtual uint64_t droppedFrames() { return dropped.load(); }
+    virtual uint64_t timeoutCount() { return timeouts.load(); }
+
+private:
+    bool attach();
+    void detach();
+    bool replaced();
+    void noFrame();
+
+    const std::string name;
+    const std::chrono::milliseconds tmoutPeriod;
+
+    shmring::header_t *hdr;
+    size_t map_size;
+    dev_t seg_dev;
+    ino_t seg_ino;
+
+    uint64_t next_seq;
+    uint64_t leased_seq;
+    shmring::slot_t *leased_slot;
+    int64_t last_stamp;
+    uint32_t status;
+    std::chrono::steady_clock::time_point last_arrival;
+    std::chrono::steady_clock::time_point last_attach_try;
+
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> timeouts;
+
+    std::vector<uint16_t> dummy;
+    std::vector<uint16_t> temp_frame;
+};
+
+#endif // SHMCAMERA_H
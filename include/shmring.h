@@ -0,0 +1,148 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <climits>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+/* Layout of the POSIX shared-memory frame ring that external acquisition processes
+ * write and ShmCamera reads. This header has no Qt dependencies so that producers can
+ * include it as is, see util/shm_producer.cpp for a minimal one.
+ *
+ * The segment starts with a header_t, followed at data_offset by num_slots slots of
+ * slot_stride bytes each. Every slot begins with a slot_t, and the frame itself
+ * (width * data_height uint16 samples, BIL like every other source) starts
+ * SLOT_HEADER_BYTES into the slot. Frame n (counting from 1) lives in slot n % num_slots.
+ *
+ * Each slot is a seqlock: the producer clears the slot's seq, writes the frame, then
+ * stores n into seq and write_seq. A reader that sees the same seq before and after
+ * copying a frame knows the producer did not touch it in between. The producer never
+ * waits for readers, a slow reader simply loses frames. */
+namespace shmring
+{
+    static const uint32_t MAGIC = 0x5253564C; // "LVSR" in memory
+    static const uint32_t VERSION = 1;
+    static const size_t SLOT_HEADER_BYTES = 64;
+    static const size_t SLOT_ALIGN = 4096;
+
+    struct header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;       // samples per line
+        uint32_t height;      // image lines
+        uint32_t data_height; // lines per frame, more than height if a header row follows the image
+        uint32_t num_slots;
+        uint64_t slot_stride; // bytes from the start of one slot to the next
+        uint64_t data_offset; // bytes from the start of the segment to slot 0
+
+        // Only these are written after the segment is set up, keep them off the line above.
+        alignas(64) std::atomic<uint64_t> write_seq; // last frame published, 0 before the first
+        std::atomic<uint32_t> wake;    // futex word, bumped after every publish
+        std::atomic<uint32_t> waiters; // readers sleeping on wake
+    };
+
+    struct slot_t
+    {
+        std::atomic<uint64_t> seq; // frame number held by the slot, 0 while it is being written
+        int64_t timestamp_ns;      // producer's capture time, -1 if it has none
+    };
+
+    static_assert(sizeof(slot_t) <= SLOT_HEADER_BYTES, "slot header does not fit");
+
+    inline size_t frameBytes(uint32_t width, uint32_t data_height)
+    {
+        return size_t(width) * data_height * sizeof(uint16_t);
+    }
+    inline uint64_t slotStride(uint32_t width, uint32_t data_height)
+    {
+        return (SLOT_HEADER_BYTES + frameBytes(width, data_height) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+    }
+    inline uint64_t dataOffset()
+    {
+        return (sizeof(header_t) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+    }
+    inline uint64_t segmentSize(const header_t *hdr)
+    {
+        return hdr->data_offset + uint64_t(hdr->num_slots) * hdr->slot_stride;
+    }
+
+    inline slot_t *slotFor(header_t *hdr, uint64_t seq)
+    {
+        return reinterpret_cast<slot_t*>(reinterpret_cast<char*>(hdr) + hdr->data_offset +
+                                         (seq % hdr->num_slots) * hdr->slot_stride);
+    }
+    inline uint16_t *pixels(slot_t *slot)
+    {
+        return reinterpret_cast<uint16_t*>(reinterpret_cast<char*>(slot) + SLOT_HEADER_BYTES);
+    }
+
+    // Fills in a freshly created (zeroed) segment. The segment must be segmentSize() bytes.
+    inline void init(header_t *hdr, uint32_t width, uint32_t height, uint32_t data_height, uint32_t num_slots)
+    {
+        hdr->width = width;
+        hdr->height = height;
+        hdr->data_height = data_height;
+        hdr->num_slots = num_slots;
+        hdr->slot_stride = slotStride(width, data_height);
+        hdr->data_offset = dataOffset();
+        hdr->write_seq.store(0);
+        hdr->wake.store(0);
+        hdr->waiters.store(0);
+        hdr->version = VERSION;
+        // Readers check the magic last, so it goes in last.
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic = MAGIC;
+    }
+
+    // Producer side. Returns where frame seq is to be written, seq must be write_seq + 1.
+    inline uint16_t *beginWrite(header_t *hdr, uint64_t seq)
+    {
+        slot_t *slot = slotFor(hdr, seq);
+        slot->seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return pixels(slot);
+    }
+    inline void commitWrite(header_t *hdr, uint64_t seq, int64_t timestamp_ns = -1)
+    {
+        slot_t *slot = slotFor(hdr, seq);
+        slot->timestamp_ns = timestamp_ns;
+        slot->seq.store(seq, std::memory_order_release);
+        hdr->write_seq.store(seq, std::memory_order_release);
+        hdr->wake.fetch_add(1);
+#ifdef __linux__
+        if (hdr->waiters.load()) {
+            // Shared futex, the readers are in another process.
+            syscall(SYS_futex, &hdr->wake, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+#endif
+    }
+
+    // Reader side. Sleeps until wake moves away from seen or timeout_ms passes.
+    inline void waitFor(header_t *hdr, uint32_t seen, int timeout_ms)
+    {
+        hdr->waiters.fetch_add(1);
+#ifdef __linux__
+        struct timespec ts = { timeout_ms / 1000, long(timeout_ms % 1000) * 1000000L };
+        if (hdr->wake.load() == seen) {
+            syscall(SYS_futex, &hdr->wake, FUTEX_WAIT, seen, &ts, nullptr, 0);
+        }
+#else
+        // No cross-process futex, poll at a rate well above any frame rate we display.
+        for (int t = 0; t < timeout_ms * 10 && hdr->wake.load() == seen; t++) {
+            usleep(100);
+        }
+#endif
+        hdr->waiters.fetch_sub(1);
+    }
+}
+
+#endif // SHMRING_H
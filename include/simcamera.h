@@ -0,0 +1,65 @@
+#ifndef SIMCAMERA_H
+#define SIMCAMERA_H
+
+#include <stdint.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <QDebug>
+
+#include "cameramodel.h"
+#include "constants.h"
+
+enum sim_pattern_t {SIM_RAMP = 0, SIM_NOISE = 1, SIM_TARGET = 2};
+
+/* Synthetic camera source for exercising the pipeline without a frame grabber.
+ * Every pattern is fully deterministic for a given seed, so two runs with the
+ * same settings produce the same frame sequence. */
+class SimCamera : public CameraModel
+{
+    Q_OBJECT
+
+public:
+    SimCamera(int frWidth = 640,
+              int frHeight = 480,
+              int dataHeight = 480,
+              sim_pattern_t pattern = SIM_RAMP,
+              double target_fps = 0.0, // 0 runs the source as fast as possible
+              double noise_sigma = 16.0,
+              bool add_defects = false,
+              uint32_t seed = 0x4C56,
+              QObject *parent = nullptr);
+    ~SimCamera();
+
+    virtual bool start();
+    virtual uint16_t *getFrame();
+    virtual uint16_t *acquireFrame(uint16_t *slot);
+
+    void setTargetFPS(double fps);
+
+private:
+    void pace();
+    void makeRamp(uint16_t *out);
+    void makeNoise(uint16_t *out);
+    void makeTarget(uint16_t *out);
+    void applyDefects(uint16_t *out);
+
+    const size_t frSize;
+    sim_pattern_t pattern;
+    double sigma;
+    bool defects;
+    uint64_t frame_no;
+
+    std::mt19937 rng;
+    std::vector<uint16_t> noise_bank; // frSize + NOISE_SPAN samples, windowed per frame
+    std::vector<uint32_t> dead_pixels;
+    std::vector<uint32_t> hot_pixels;
+    std::vector<uint16_t> temp_frame;
+
+    std::chrono::steady_clock::duration period;
+    std::chrono::steady_clock::time_point next_deadline;
+};
+
+#endif // SIMCAMERA_H
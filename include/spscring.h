@@ -0,0 +1,135 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/* Bounded single-producer/single-consumer queue of preallocated frame slots.
+ *
+ * The producer fills a slot in place between beginWrite() and commitWrite(), the
+ * consumer uses it in place between beginRead() and endRead(), so no frame is
+ * ever allocated or copied by the queue itself. head and tail are only advanced
+ * by their owning side. The release store that publishes a slot pairs with the
+ * acquire load on the other side, so the slot contents are visible before the
+ * index is.
+ *
+ * Waiting is lock-free on the fast path. A side only takes the mutex when it has
+ * to sleep (queue full or empty) or when it must wake a sleeping peer. The
+ * waiting flags and indices use sequentially consistent operations so that a
+ * wakeup can never be lost between the peer's check and its wait. */
+class SPSCFrameRing
+{
+public:
+    SPSCFrameRing(size_t num_slots, size_t frame_size) :
+        storage(num_slots * frame_size, 0), nSlots(num_slots), frSize(frame_size),
+        head(0), tail(0), closed(false), producer_waiting(false), consumer_waiting(false)
+    {}
+
+    size_t capacity() const { return nSlots; }
+    size_t frameSize() const { return frSize; }
+    size_t size() const { return head.load() - tail.load(); }
+    bool empty() const { return size() == 0; }
+
+    // Producer side. Returns nullptr if the ring stayed full for timeout_ms, or was closed.
+    uint16_t *beginWrite(int timeout_ms)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == nSlots) {
+            std::unique_lock<std::mutex> lock(wait_lock);
+            producer_waiting.store(true);
+            not_full.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, h]() {
+                return h - tail.load() < nSlots || closed.load();
+            });
+            producer_waiting.store(false);
+            if (h - tail.load() == nSlots || closed.load()) {
+                return nullptr;
+            }
+        }
+        return &storage[(h % nSlots) * frSize];
+    }
+    void commitWrite()
+    {
+        head.fetch_add(1);
+        if (consumer_waiting.load()) {
+            std::lock_guard<std::mutex> lock(wait_lock);
+            not_empty.notify_one();
+        }
+    }
+
+    // Consumer side. Returns nullptr if nothing arrived within timeout_ms (0 polls).
+    uint16_t *beginRead(int timeout_ms)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) {
+            if (timeout_ms <= 0) {
+                return nullptr;
+            }
+            std::unique_lock<std::mutex> lock(wait_lock);
+            consumer_waiting.store(true);
+            not_empty.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, t]() {
+                return head.load() != t || closed.load();
+            });
+            consumer_waiting.store(false);
+            if (head.load() == t) {
+                return nullptr;
+            }
+        }
+        return &storage[(t % nSlots) * frSize];
+    }
+    void endRead()
+    {
+        tail.fetch_add(1);
+        if (producer_waiting.load()) {
+            std::lock_guard<std::mutex> lock(wait_lock);
+            not_full.notify_one();
+        }
+    }
+
+    // Position of a slot returned by beginWrite()/beginRead(), for keeping per-slot side data.
+    size_t slotIndex(const uint16_t *slot) const { return size_t(slot - storage.data()) / frSize; }
+
+    // Wakes up and turns away both sides, e.g. before joining the producer thread.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(wait_lock);
+        closed.store(true);
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+    // Empties and reopens the ring. Neither side may be inside the ring when this is called.
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(wait_lock);
+        head.store(0);
+        tail.store(0);
+        closed.store(false);
+    }
+
+private:
+    SPSCFrameRing(const SPSCFrameRing&) = delete;
+    SPSCFrameRing& operator=(const SPSCFrameRing&) = delete;
+
+    std::vector<uint16_t> storage;
+    const size_t nSlots;
+    const size_t frSize;
+
+    // Keep the two indices on separate cache lines so the two threads don't false share.
+    char pad0[64];
+    std::atomic<size_t> head; // written by the producer only
+    char pad1[64];
+    std::atomic<size_t> tail; // written by the consumer only
+    char pad2[64];
+
+    std::atomic<bool> closed;
+    std::atomic<bool> producer_waiting;
+    std::atomic<bool> consumer_waiting;
+    std::mutex wait_lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,74 @@
+#ifndef STAGEGRAPH_H
+#define STAGEGRAPH_H
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image_type.h"
+#include "lvstage.h"
+
+class WorkStealingPool;
+
+/* Runs a set of LVStages on each frame handed to it, in the order their inputs give.
+ *
+ * Every submitted frame makes one pass through the graph. A stage starts on the pool as
+ * soon as the stages it reads from are through, so the stages of a pass that do not depend
+ * on each other run in parallel, and a slow stage only holds up its own dependents: the
+ * next frame already runs through the stages that are free again. */
+class StageGraph
+{
+public:
+    explicit StageGraph(WorkStealingPool *pool);
+    // Waits for the passes in flight, then deletes the stages.
+    ~StageGraph();
+
+    // Takes ownership of stage. Stages may be added in any order, but only before build().
+    void add(const std::string &name, LVStage *stage);
+    /* Resolves the inputs and puts the stages in dependency order. Stages reading from one
+     * that is missing, or from themselves through a cycle, are dropped with a warning. */
+    void build();
+
+    /* Runs the graph on frame seq in raw slot raw_index. done is called once the last stage
+     * of the pass has finished, on whichever thread that was, or right here if every stage
+     * was still busy. Returns false, without calling done, once the graph is closed. */
+    bool submit(uint64_t seq, uint16_t raw_index, std::function<void()> done);
+    // Frames that never made it into the graph, skipped by every stage.
+    void skip(uint64_t frames);
+    // Refuses further frames and waits for the passes in flight to be done.
+    void close();
+
+    std::vector<std::string> stageNames() const;
+    // All zeros for a stage not in the graph.
+    stage_stats_t stats(const std::string &name) const;
+    void resetStats();
+
+private:
+    StageGraph(const StageGraph&) = delete;
+    StageGraph& operator=(const StageGraph&) = delete;
+
+    struct node_t
+    {
+        std::string name;
+        LVStage *stage;
+        std::vector<int> inputs;    // in the order stage->inputs() names them
+        std::vector<int> consumers;
+        std::atomic<bool> busy;     // admitted to a pass that is not through with it yet
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> skipped;
+    };
+    struct pass_t;
+
+    void run(pass_t *pass, int n);
+    void release(pass_t *pass, int n);
+
+    WorkStealingPool *pool;
+    std::vector<std::unique_ptr<node_t>> nodes; // in dependency order after build()
+    std::atomic<bool> closed;
+    std::atomic<int> in_flight;
+};
+
+#endif // STAGEGRAPH_H
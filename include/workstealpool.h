@@ -0,0 +1,57 @@
+#ifndef WORKSTEALPOOL_H
+#define WORKSTEALPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads, each with a task deque of its own.
+ *
+ * A task submitted from one of the workers goes onto that worker's deque, where it runs next
+ * (last in, first out), so a stage that hands its frame on to the next stage keeps the frame
+ * in the same cache. Tasks submitted from outside are spread over the deques in turn. A
+ * worker with nothing left of its own steals the oldest task of another before it goes to
+ * sleep, so independent tasks end up running side by side.
+ *
+ * The deques are short and only locked for a push or a pop. Workers sleep on one condition
+ * variable, and a submitter only takes its lock when someone is asleep. */
+class WorkStealingPool
+{
+public:
+    // With cpus given, every worker is pinned to that set.
+    explicit WorkStealingPool(int num_threads, const std::vector<int> &cpus = std::vector<int>());
+    // Runs what is still queued, then joins the workers.
+    ~WorkStealingPool();
+
+    void submit(std::function<void()> task);
+    int size() const { return int(workers.size()); }
+
+private:
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    struct queue_t
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(int self, std::vector<int> cpus);
+    bool take(int self, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<queue_t>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue; // for submissions from outside the pool
+    std::atomic<int> queued;
+    std::atomic<int> sleepers;
+    std::atomic<bool> stopping;
+    std::mutex park_lock;
+    std::condition_variable work_ready;
+};
+
+#endif // WORKSTEALPOOL_H
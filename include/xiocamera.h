@@ -4,19 +4,22 @@
 #include <stdlib.h>
 #include <cstring>
 #include <fstream>
-#include <deque>
 #include <vector>
 #include <array>
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include <QDebug>
 #include <QDir>
 #include <QtConcurrent/QtConcurrent>
 #include <QFuture>
 
-#include "alphanum.hpp"
-
+#include "dirfollower.h"
+#include "spscring.h"
 #include "osutils.h"
 #include "cameramodel.h"
 #include "constants.h"
@@ -34,34 +37,90 @@ public:
     XIOCamera(int frWidth = 640,
               int frHeight = 480,
               int dataHeight = 480,
+              int ioDepth = 4,
+              int readaheadMB = 256,
               QObject *parent = nullptr);
     ~XIOCamera();
 
     virtual void setDir(const char *dirname);
 
     virtual uint16_t* getFrame();
+    virtual uint16_t* acquireFrame(uint16_t *slot);
+    virtual void releaseFrame(uint16_t *frame);
+    virtual int64_t frameTimestamp() { return last_stamp; }
+    virtual uint32_t frameStatus() { return no_data ? FRAME_NO_DATA : FRAME_OK; }
+
+    // Every XIO file holds nFrames frames, so the sorted file index doubles as a frame index.
+    virtual bool isSeekable() { return true; }
+    virtual int64_t frameCount() { return indexed_files.load() * nFrames; }
+    virtual bool seek(int64_t frame);
+    virtual void setPlayDirection(int dir);
 
 private:
-    std::string getFname();
-    void readFile();
+    struct xio_file_t {
+        std::vector<uint16_t> frames; // empty if the file was skipped
+        int64_t index;
+        int64_t mtime_ns;
+    };
+
+    void startReading(int64_t first_frame);
+    void stopReading();
+    void applySeek();
+    bool takeFile(std::string &fname, int64_t &index);
+    void ioWorker();
+    bool loadFile(const std::string &fname, std::vector<uint16_t> &buf, int64_t &mtime_ns);
     void readLoop();
 
-    bool is_reading; // Flag that is true while reading from a directory
-    std::ifstream dev_p;
-    std::string ifname;
+    std::atomic<bool> is_reading; // Flag that is true while reading from a directory
     std::string data_dir;
-    std::streampos bufsize;
     const int nFrames;
-    size_t framesize;
     const int headsize;
+    const size_t frSize;
 
-    size_t image_no;
-    std::vector<std::string> xio_files;
-    std::deque< std::vector<uint16_t> > frame_buf;
-    std::vector<unsigned char> header;
+    DirFollower xio_files;
+    SPSCFrameRing frame_ring;
     std::vector<uint16_t> dummy;
     std::vector<uint16_t> temp_frame;
 
+    /* XIO frames carry no timestamps of their own. The recorder closes each file as
+     * soon as it is full, so the frames of a file are spread evenly between the mtime
+     * of the previous file and its own. slot_stamps holds that estimate for each ring
+     * slot, or -1 when there is no previous file to measure from. */
+    std::vector<int64_t> slot_stamps;
+    int64_t prev_mtime;
+    int64_t last_stamp;
+    bool no_data; // the last frame handed out was the blank dummy
+    std::vector<int64_t> slot_frames; // frame number held by each ring slot
+
+    /* Seeking and changes of direction restart the read-ahead pipeline at the new
+     * position. This is done by the consuming thread on its next acquireFrame(), so
+     * the ring is never reset while a frame is leased out of it. setDir() is called
+     * from the GUI thread instead, and waits on lease_lock for the leased frame to
+     * come back first. lease_lock is always taken before control_lock. */
+    std::mutex lease_lock; // held from acquireFrame() to releaseFrame()
+    std::mutex control_lock;
+    std::atomic<bool> seek_pending;
+    std::atomic<int64_t> seek_target;
+    std::atomic<int64_t> indexed_files;
+    int read_dir;       // play_dir when the pipeline was started
+    int64_t start_frame; // frames of the first file before this are skipped
+
+    /* Read-ahead. io_depth workers each load a whole file into a buffer, and readLoop
+     * feeds the buffers into frame_ring in filename order. Every file is given a ticket
+     * in the order it is taken from xio_files. Tickets are only handed out while fewer
+     * than max_files_ahead files are loaded or loading, which bounds the memory held by
+     * read-ahead to the configured budget. */
+    int io_depth;
+    size_t max_files_ahead;
+    std::vector<std::thread> io_threads;
+    std::mutex io_lock;
+    std::condition_variable io_cv;
+    std::map<uint64_t, xio_file_t> completed;
+    std::vector< std::vector<uint16_t> > spare_bufs;
+    uint64_t next_ticket;
+    uint64_t next_emit;
+    int64_t next_file;
+
     QFuture<void> readLoopFuture;
     int tmoutPeriod;
 };
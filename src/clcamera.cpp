@@ -69,10 +69,10 @@ uint16_t* CLCamera::getFrame()
     if ((overrun = (edt_reg_read(dev_p, PDV_STAT) & PDV_OVERRUN)))
         ++overruns;
 
-    timeouts = pdv_timeouts(dev_p);
-    if (timeouts > last_timeouts) {
+    timeouts.store(pdv_timeouts(dev_p));
+    if (timeouts.load() > last_timeouts) {
         pdv_timeout_restart(dev_p, true);
-        last_timeouts = timeouts;
+        last_timeouts = timeouts.load();
         recovering_timeout = true;
         emit timeout();
     } else if (recovering_timeout) {
@@ -84,3 +84,8 @@ uint16_t* CLCamera::getFrame()
     return image_p;
 
 }
+
+uint32_t CLCamera::frameStatus()
+{
+    return (overrun ? FRAME_OVERRUN : FRAME_OK) | (recovering_timeout ? FRAME_TIMEOUT : FRAME_OK);
+}
@@ -1,8 +1,10 @@
 #include "darksubfilter.h"
 
+#include <climits>
+
 DarkSubFilter::DarkSubFilter(size_t frame_size) :
-    mask_collected(true), frSize(frame_size),
-    nSamples(0), avgd_frames(0)
+    mask_collected(true), collect_in_callback(true), frSize(frame_size),
+    nSamples(0), avgd_frames(0), simd(dsf::kernels())
 {
     mask.resize(frSize);
     mask_accum.resize(frSize);
@@ -13,20 +15,24 @@ DarkSubFilter::~DarkSubFilter()
     mask_collected = false;
 }
 
-void DarkSubFilter::start_mask_collection(const quint64 &avgf)
+void DarkSubFilter::start_mask_collection(const quint64 &avgf, bool lossless)
 {
+    std::lock_guard<std::mutex> lock(mask_mutex);
     avgd_frames = avgf;
-    mask_collected = false;
+    collect_in_callback = !lossless;
+    if (lossless) {
+        batch_sum.resize(frSize);
+    }
     nSamples = 0;
     std::fill (mask.begin(), mask.end(), 0.0);
     std::fill (mask_accum.begin(), mask_accum.end(), 0.0);
+    mask_collected = false;
 }
 
 void DarkSubFilter::finish_mask_collection()
 {
-    for (size_t i = 0; i < frSize; i++) {
-        mask[i] = static_cast<float>(mask_accum[i] / nSamples);
-    }
+    std::lock_guard<std::mutex> lock(mask_mutex);
+    simd.average(mask_accum.data(), double(nSamples), mask.data(), frSize);
     mask_collected = true;
 
     qDebug("Mask collected!");
@@ -34,32 +40,61 @@ void DarkSubFilter::finish_mask_collection()
 
 void DarkSubFilter::collect_mask(const uint16_t *in_frame)
 {
-    for (size_t i = 0; i < frSize; i++) {
-        mask_accum[i] = in_frame[i] + mask_accum[i];
+    // Frames that come in before the mask is finished do not go into it.
+    if (frames_wanted() == 0) {
+        return;
     }
+    simd.accumulate(in_frame, mask_accum.data(), frSize);
 
     nSamples++;
-    if (avgd_frames != 0 && nSamples >= avgd_frames) {
+    if (frames_wanted() == 0) {
         mask_frames_collected();
     }
 }
 
-void DarkSubFilter::dark_subtract(const uint16_t *in_frame, float *out_frame)
+quint64 DarkSubFilter::frames_wanted()
 {
-    for (size_t i = 0; i < frSize; i++) {
-        out_frame[i] = in_frame[i] - mask[i];
+    if (avgd_frames == 0) {
+        return ULLONG_MAX;
     }
+    return nSamples < avgd_frames ? avgd_frames - nSamples : 0;
+}
+
+bool DarkSubFilter::collect_frames(const uint16_t *const *frames, size_t count,
+                                   const std::function<bool()> &intact)
+{
+    std::lock_guard<std::mutex> lock(mask_mutex);
+    if (mask_collected || count > frames_wanted()) {
+        return false;
+    }
+    simd.sum_frames(frames, count, batch_sum.data(), frSize);
+    if (!intact()) {
+        return false;
+    }
+    simd.add_sums(batch_sum.data(), mask_accum.data(), frSize);
+
+    nSamples += count;
+    if (frames_wanted() == 0) {
+        mask_frames_collected();
+    }
+    return true;
+}
+
+void DarkSubFilter::dark_subtract(const uint16_t *in_frame, float *out_frame)
+{
+    simd.subtract(in_frame, mask.data(), out_frame, frSize);
 }
 
 void DarkSubFilter::dsf_callback(uint16_t *in_frame, float *out_frame)
 {
     if (mask_collected) {
         dark_subtract(in_frame, out_frame);
+    } else if (!collect_in_callback) {
+        // The mask is collected from the ring elsewhere, show the raw frames meanwhile.
+        simd.widen(in_frame, out_frame, frSize);
     } else {
         mask_mutex.lock();
-        for (size_t i = 0; i < frSize; i++) {
-            out_frame[i] = in_frame[i];
-        }
+        simd.widen(in_frame, out_frame, frSize);
         collect_mask(in_frame);
         mask_mutex.unlock();
     }
@@ -0,0 +1,174 @@
+#include "dirfollower.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <QDebug>
+
+DirFollower::DirFollower() :
+    inotify_fd(-1), watch_fd(-1), cursor(0)
+{}
+
+DirFollower::~DirFollower()
+{
+    stop();
+}
+
+bool DirFollower::follow(const std::string &directory)
+{
+    stop();
+    dir = directory;
+    if (dir.empty()) {
+        return false;
+    }
+
+#ifdef __linux__
+    // Start watching before the initial listing so that no file can slip in between the two.
+    // Files are only announced once they have been completely written or moved into place.
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd != -1) {
+        watch_fd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch_fd == -1) {
+            qDebug() << "Unable to watch" << dir.data() << "for new files:" << strerror(errno);
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+#endif
+
+    std::vector<std::string> fname_list;
+    os::listdir(fname_list, dir);
+    // Sort the frames in the product directory by filename, as mtime is unreliable.
+    std::sort(fname_list.begin(), fname_list.end(), less);
+    for (auto &f : fname_list) {
+        if (accept(f)) {
+            files.push_back(f);
+            known.insert(f);
+        }
+    }
+    return true;
+}
+
+void DirFollower::stop()
+{
+    if (inotify_fd != -1) {
+        close(inotify_fd); // also removes the watch
+        inotify_fd = -1;
+        watch_fd = -1;
+    }
+    files.clear();
+    known.clear();
+    cursor = 0;
+}
+
+bool DirFollower::next(std::string &fname)
+{
+    if (cursor == files.size()) {
+        poll();
+    }
+    if (cursor < files.size()) {
+        fname = files[cursor++];
+        return true;
+    }
+    return false;
+}
+
+bool DirFollower::at(size_t index, std::string &fname)
+{
+    if (index >= files.size()) {
+        poll();
+    }
+    if (index < files.size()) {
+        fname = files[index];
+        // Nothing at or before a file that has been handed out may move.
+        cursor = std::max(cursor, index + 1);
+        return true;
+    }
+    return false;
+}
+
+void DirFollower::wait(int timeout_ms)
+{
+    if (inotify_fd != -1) {
+        struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+        ::poll(&pfd, 1, timeout_ms);
+    } else {
+        usleep(useconds_t(timeout_ms) * 1000);
+    }
+}
+
+void DirFollower::poll()
+{
+    if (dir.empty()) {
+        return;
+    }
+    if (inotify_fd == -1) {
+        // No inotify on this platform (or we ran out of watches), look at the directory again.
+        rescan();
+        return;
+    }
+#ifdef __linux__
+    alignas(struct inotify_event) char buf[16384];
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ) {
+            auto event = reinterpret_cast<const struct inotify_event*>(ptr);
+            if (event->mask & IN_Q_OVERFLOW) {
+                // The kernel dropped events, so we can no longer trust the index to be complete.
+                rescan();
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                std::string path = dir + "/" + event->name;
+                if (accept(path)) {
+                    insert(path);
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+void DirFollower::rescan()
+{
+    std::vector<std::string> fname_list;
+    os::listdir(fname_list, dir);
+    std::sort(fname_list.begin(), fname_list.end(), less);
+    for (auto &f : fname_list) {
+        if (accept(f)) {
+            insert(f);
+        }
+    }
+}
+
+void DirFollower::insert(const std::string &path)
+{
+    if (!known.insert(path).second) {
+        return;
+    }
+    // Files almost always arrive in order, which makes this an append.
+    if (files.empty() || !less(path, files.back())) {
+        files.push_back(path);
+        return;
+    }
+    // A late file that sorts before data we have already played is read next
+    // rather than being skipped, so nothing before the cursor ever moves.
+    auto pos = std::upper_bound(files.begin() + long(cursor), files.end(), path, less);
+    files.insert(pos, path);
+}
+
+bool DirFollower::accept(const std::string &fname)
+{
+    if (fname.empty()) {
+        return false;
+    }
+    std::string ext = os::getext(fname);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "xio" || ext == "decomp";
+}
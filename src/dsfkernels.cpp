@@ -0,0 +1,542 @@
+#include "dsfkernels.h"
+
+#include <cstring>
+
+#include <QDebug>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSF_X86 1
+#include <immintrin.h>
+// Each x86 set is compiled for its own target, the rest of LiveView does not need the flags.
+#define DSF_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define DSF_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+void subtract_scalar(const uint16_t *in, const float *mask, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i] - mask[i];
+    }
+}
+
+void widen_scalar(const uint16_t *in, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i];
+    }
+}
+
+void accumulate_scalar(const uint16_t *in, double *accum, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        accum[i] = in[i] + accum[i];
+    }
+}
+
+void average_scalar(const double *accum, double samples, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = static_cast<float>(accum[i] / samples);
+    }
+}
+
+void sum_frames_scalar(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = 0;
+        for (size_t f = 0; f < count; f++) {
+            s += frames[f][i];
+        }
+        sum[i] = s;
+    }
+}
+
+void add_sums_scalar(const uint32_t *sum, double *accum, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        accum[i] = sum[i] + accum[i];
+    }
+}
+
+#ifdef DSF_X86
+/* uint16 goes to int32 (exact), then to float or double (exact), so the only rounding is in
+ * the one subtraction, addition or division, same as in the scalar loops. */
+
+DSF_TARGET("sse4.1")
+void subtract_sse41(const uint16_t *in, const float *mask, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_cvtepi32_ps(px), _mm_loadu_ps(mask + i)));
+    }
+    subtract_scalar(in + i, mask + i, out + i, n - i);
+}
+
+DSF_TARGET("sse4.1")
+void widen_sse41(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(px));
+    }
+    widen_scalar(in + i, out + i, n - i);
+}
+
+DSF_TARGET("sse4.1")
+void accumulate_sse41(const uint16_t *in, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm_storeu_pd(accum + i, _mm_add_pd(_mm_cvtepi32_pd(px), _mm_loadu_pd(accum + i)));
+        _mm_storeu_pd(accum + i + 2, _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(px, 8)),
+                                                _mm_loadu_pd(accum + i + 2)));
+    }
+    accumulate_scalar(in + i, accum + i, n - i);
+}
+
+DSF_TARGET("sse4.1")
+void average_sse41(const double *accum, double samples, float *out, size_t n)
+{
+    const __m128d div = _mm_set1_pd(samples);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(accum + i), div));
+        __m128 hi = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(accum + i + 2), div));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    average_scalar(accum + i, samples, out + i, n - i);
+}
+
+DSF_TARGET("sse4.1")
+void sum_frames_sse41(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = zero, hi = zero;
+        for (size_t f = 0; f < count; f++) {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frames[f] + i));
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(px, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(px, zero));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i + 4), hi);
+    }
+    for (; i < n; i++) {
+        uint32_t s = 0;
+        for (size_t f = 0; f < count; f++) {
+            s += frames[f][i];
+        }
+        sum[i] = s;
+    }
+}
+
+DSF_TARGET("sse4.1")
+void add_sums_sse41(const uint32_t *sum, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + i));
+        _mm_storeu_pd(accum + i, _mm_add_pd(_mm_cvtepi32_pd(s), _mm_loadu_pd(accum + i)));
+        _mm_storeu_pd(accum + i + 2, _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(s, 8)),
+                                                _mm_loadu_pd(accum + i + 2)));
+    }
+    add_sums_scalar(sum + i, accum + i, n - i);
+}
+
+DSF_TARGET("avx2")
+void subtract_avx2(const uint16_t *in, const float *mask, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i px = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_cvtepi32_ps(px), _mm256_loadu_ps(mask + i)));
+    }
+    subtract_scalar(in + i, mask + i, out + i, n - i);
+}
+
+DSF_TARGET("avx2")
+void widen_avx2(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i px = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(px));
+    }
+    widen_scalar(in + i, out + i, n - i);
+}
+
+DSF_TARGET("avx2")
+void accumulate_avx2(const uint16_t *in, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i px = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(px));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(px, 1));
+        _mm256_storeu_pd(accum + i, _mm256_add_pd(lo, _mm256_loadu_pd(accum + i)));
+        _mm256_storeu_pd(accum + i + 4, _mm256_add_pd(hi, _mm256_loadu_pd(accum + i + 4)));
+    }
+    accumulate_scalar(in + i, accum + i, n - i);
+}
+
+DSF_TARGET("avx2")
+void average_avx2(const double *accum, double samples, float *out, size_t n)
+{
+    const __m256d div = _mm256_set1_pd(samples);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_loadu_pd(accum + i), div));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_loadu_pd(accum + i + 4), div));
+        _mm256_storeu_ps(out + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    average_scalar(accum + i, samples, out + i, n - i);
+}
+
+DSF_TARGET("avx2")
+void sum_frames_avx2(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (size_t f = 0; f < count; f++) {
+            const __m128i *px = reinterpret_cast<const __m128i*>(frames[f] + i);
+            lo = _mm256_add_epi32(lo, _mm256_cvtepu16_epi32(_mm_loadu_si128(px)));
+            hi = _mm256_add_epi32(hi, _mm256_cvtepu16_epi32(_mm_loadu_si128(px + 1)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sum + i), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sum + i + 8), hi);
+    }
+    for (; i < n; i++) {
+        uint32_t s = 0;
+        for (size_t f = 0; f < count; f++) {
+            s += frames[f][i];
+        }
+        sum[i] = s;
+    }
+}
+
+DSF_TARGET("avx2")
+void add_sums_avx2(const uint32_t *sum, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i *s = reinterpret_cast<const __m128i*>(sum + i);
+        __m256d lo = _mm256_cvtepi32_pd(_mm_loadu_si128(s));
+        __m256d hi = _mm256_cvtepi32_pd(_mm_loadu_si128(s + 1));
+        _mm256_storeu_pd(accum + i, _mm256_add_pd(lo, _mm256_loadu_pd(accum + i)));
+        _mm256_storeu_pd(accum + i + 4, _mm256_add_pd(hi, _mm256_loadu_pd(accum + i + 4)));
+    }
+    add_sums_scalar(sum + i, accum + i, n - i);
+}
+
+// GCC's own AVX-512 headers set off -Wmaybe-uninitialized when inlined, a false positive.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+DSF_TARGET("avx512f")
+void subtract_avx512(const uint16_t *in, const float *mask, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i px = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+        _mm512_storeu_ps(out + i, _mm512_sub_ps(_mm512_cvtepi32_ps(px), _mm512_loadu_ps(mask + i)));
+    }
+    subtract_scalar(in + i, mask + i, out + i, n - i);
+}
+
+DSF_TARGET("avx512f")
+void widen_avx512(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i px = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+        _mm512_storeu_ps(out + i, _mm512_cvtepi32_ps(px));
+    }
+    widen_scalar(in + i, out + i, n - i);
+}
+
+DSF_TARGET("avx512f")
+void accumulate_avx512(const uint16_t *in, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i px = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+        __m512d lo = _mm512_cvtepi32_pd(_mm512_castsi512_si256(px));
+        __m512d hi = _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(px, 1));
+        _mm512_storeu_pd(accum + i, _mm512_add_pd(lo, _mm512_loadu_pd(accum + i)));
+        _mm512_storeu_pd(accum + i + 8, _mm512_add_pd(hi, _mm512_loadu_pd(accum + i + 8)));
+    }
+    accumulate_scalar(in + i, accum + i, n - i);
+}
+
+DSF_TARGET("avx512f")
+void average_avx512(const double *accum, double samples, float *out, size_t n)
+{
+    const __m512d div = _mm512_set1_pd(samples);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm512_cvtpd_ps(_mm512_div_pd(_mm512_loadu_pd(accum + i), div)));
+    }
+    average_scalar(accum + i, samples, out + i, n - i);
+}
+
+DSF_TARGET("avx512f")
+void sum_frames_avx512(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i lo = _mm512_setzero_si512(), hi = _mm512_setzero_si512();
+        for (size_t f = 0; f < count; f++) {
+            const __m256i *px = reinterpret_cast<const __m256i*>(frames[f] + i);
+            lo = _mm512_add_epi32(lo, _mm512_cvtepu16_epi32(_mm256_loadu_si256(px)));
+            hi = _mm512_add_epi32(hi, _mm512_cvtepu16_epi32(_mm256_loadu_si256(px + 1)));
+        }
+        _mm512_storeu_si512(sum + i, lo);
+        _mm512_storeu_si512(sum + i + 16, hi);
+    }
+    for (; i < n; i++) {
+        uint32_t s = 0;
+        for (size_t f = 0; f < count; f++) {
+            s += frames[f][i];
+        }
+        sum[i] = s;
+    }
+}
+
+DSF_TARGET("avx512f")
+void add_sums_avx512(const uint32_t *sum, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i *s = reinterpret_cast<const __m256i*>(sum + i);
+        __m512d lo = _mm512_cvtepi32_pd(_mm256_loadu_si256(s));
+        __m512d hi = _mm512_cvtepi32_pd(_mm256_loadu_si256(s + 1));
+        _mm512_storeu_pd(accum + i, _mm512_add_pd(lo, _mm512_loadu_pd(accum + i)));
+        _mm512_storeu_pd(accum + i + 8, _mm512_add_pd(hi, _mm512_loadu_pd(accum + i + 8)));
+    }
+    add_sums_scalar(sum + i, accum + i, n - i);
+}
+
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef DSF_NEON
+void subtract_neon(const uint16_t *in, const float *mask, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t px = vld1q_u16(in + i);
+        float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(px)));
+        float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(px)));
+        vst1q_f32(out + i, vsubq_f32(lo, vld1q_f32(mask + i)));
+        vst1q_f32(out + i + 4, vsubq_f32(hi, vld1q_f32(mask + i + 4)));
+    }
+    subtract_scalar(in + i, mask + i, out + i, n - i);
+}
+
+void widen_neon(const uint16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t px = vld1q_u16(in + i);
+        vst1q_f32(out + i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(px))));
+        vst1q_f32(out + i + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(px))));
+    }
+    widen_scalar(in + i, out + i, n - i);
+}
+
+void accumulate_neon(const uint16_t *in, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t px = vmovl_u16(vld1_u16(in + i));
+        float64x2_t lo = vcvtq_f64_u64(vmovl_u32(vget_low_u32(px)));
+        float64x2_t hi = vcvtq_f64_u64(vmovl_u32(vget_high_u32(px)));
+        vst1q_f64(accum + i, vaddq_f64(lo, vld1q_f64(accum + i)));
+        vst1q_f64(accum + i + 2, vaddq_f64(hi, vld1q_f64(accum + i + 2)));
+    }
+    accumulate_scalar(in + i, accum + i, n - i);
+}
+
+void average_neon(const double *accum, double samples, float *out, size_t n)
+{
+    const float64x2_t div = vdupq_n_f64(samples);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x2_t lo = vcvt_f32_f64(vdivq_f64(vld1q_f64(accum + i), div));
+        float32x2_t hi = vcvt_f32_f64(vdivq_f64(vld1q_f64(accum + i + 2), div));
+        vst1q_f32(out + i, vcombine_f32(lo, hi));
+    }
+    average_scalar(accum + i, samples, out + i, n - i);
+}
+
+void sum_frames_neon(const uint16_t *const *frames, size_t count, uint32_t *sum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint32x4_t lo = vdupq_n_u32(0), hi = vdupq_n_u32(0);
+        for (size_t f = 0; f < count; f++) {
+            uint16x8_t px = vld1q_u16(frames[f] + i);
+            lo = vaddw_u16(lo, vget_low_u16(px));
+            hi = vaddw_u16(hi, vget_high_u16(px));
+        }
+        vst1q_u32(sum + i, lo);
+        vst1q_u32(sum + i + 4, hi);
+    }
+    for (; i < n; i++) {
+        uint32_t s = 0;
+        for (size_t f = 0; f < count; f++) {
+            s += frames[f][i];
+        }
+        sum[i] = s;
+    }
+}
+
+void add_sums_neon(const uint32_t *sum, double *accum, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t s = vld1q_u32(sum + i);
+        float64x2_t lo = vcvtq_f64_u64(vmovl_u32(vget_low_u32(s)));
+        float64x2_t hi = vcvtq_f64_u64(vmovl_u32(vget_high_u32(s)));
+        vst1q_f64(accum + i, vaddq_f64(lo, vld1q_f64(accum + i)));
+        vst1q_f64(accum + i + 2, vaddq_f64(hi, vld1q_f64(accum + i + 2)));
+    }
+    add_sums_scalar(sum + i, accum + i, n - i);
+}
+#endif
+
+const dsf::kernels_t scalar_kernels = {
+    "scalar", &subtract_scalar, &widen_scalar, &accumulate_scalar, &average_scalar,
+    &sum_frames_scalar, &add_sums_scalar
+};
+#ifdef DSF_X86
+const dsf::kernels_t sse41_kernels = {
+    "SSE4.1", &subtract_sse41, &widen_sse41, &accumulate_sse41, &average_sse41,
+    &sum_frames_sse41, &add_sums_sse41
+};
+const dsf::kernels_t avx2_kernels = {
+    "AVX2", &subtract_avx2, &widen_avx2, &accumulate_avx2, &average_avx2,
+    &sum_frames_avx2, &add_sums_avx2
+};
+const dsf::kernels_t avx512_kernels = {
+    "AVX-512", &subtract_avx512, &widen_avx512, &accumulate_avx512, &average_avx512,
+    &sum_frames_avx512, &add_sums_avx512
+};
+#endif
+#ifdef DSF_NEON
+const dsf::kernels_t neon_kernels = {
+    "NEON", &subtract_neon, &widen_neon, &accumulate_neon, &average_neon,
+    &sum_frames_neon, &add_sums_neon
+};
+#endif
+
+const dsf::kernels_t &pick()
+{
+    for (const dsf::kernels_t *k : dsf::supported()) {
+        if (dsf::matchesScalar(*k)) {
+            qDebug("Dark subtraction uses the %s kernels.", k->name);
+            return *k;
+        }
+        qWarning("The %s dark subtraction kernels disagree with the scalar ones, not using them.", k->name);
+    }
+    return scalar_kernels;
+}
+
+} // namespace
+
+const dsf::kernels_t &dsf::kernels()
+{
+    static const kernels_t &picked = pick();
+    return picked;
+}
+
+const dsf::kernels_t &dsf::scalar()
+{
+    return scalar_kernels;
+}
+
+std::vector<const dsf::kernels_t*> dsf::supported()
+{
+    std::vector<const kernels_t*> sets;
+#ifdef DSF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        sets.push_back(&avx512_kernels);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        sets.push_back(&avx2_kernels);
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        sets.push_back(&sse41_kernels);
+    }
+#endif
+#ifdef DSF_NEON
+    sets.push_back(&neon_kernels);
+#endif
+    return sets;
+}
+
+bool dsf::matchesScalar(const kernels_t &k)
+{
+    // Long enough for a few full vectors of the widest set, odd so that every tail is taken.
+    // Starting one element in leaves the vectors unaligned.
+    const size_t n = 1000 + 37;
+    const size_t frames = 5;
+    std::vector<uint16_t> in(n + frames);
+    std::vector<float> mask(n + 1), want(n + 1), got(n + 1);
+    std::vector<double> want_acc(n + 1), got_acc(n + 1);
+    uint32_t state = 0x4C56;
+    for (size_t i = 0; i < in.size(); i++) {
+        state = state * 1664525u + 1013904223u;
+        in[i] = i < 4 ? uint16_t(i & 1 ? 0xFFFF : 0) : uint16_t(state >> 16);
+    }
+    for (size_t i = 0; i <= n; i++) {
+        state = state * 1664525u + 1013904223u;
+        mask[i] = float(int32_t(state) % 70000) / 7.0f;
+        want_acc[i] = got_acc[i] = double(state) * 1e4 + 0.1;
+    }
+
+    bool same = true;
+    scalar_kernels.subtract(in.data() + 1, mask.data() + 1, want.data() + 1, n);
+    k.subtract(in.data() + 1, mask.data() + 1, got.data() + 1, n);
+    same = same && !memcmp(want.data(), got.data(), got.size() * sizeof(float));
+
+    scalar_kernels.widen(in.data() + 1, want.data() + 1, n);
+    k.widen(in.data() + 1, got.data() + 1, n);
+    same = same && !memcmp(want.data(), got.data(), got.size() * sizeof(float));
+
+    for (int pass = 0; pass < 3; pass++) {
+        scalar_kernels.accumulate(in.data() + 1, want_acc.data() + 1, n);
+        k.accumulate(in.data() + 1, got_acc.data() + 1, n);
+    }
+    same = same && !memcmp(want_acc.data(), got_acc.data(), got_acc.size() * sizeof(double));
+
+    scalar_kernels.average(want_acc.data() + 1, 7.0, want.data() + 1, n);
+    k.average(want_acc.data() + 1, 7.0, got.data() + 1, n);
+    same = same && !memcmp(want.data(), got.data(), got.size() * sizeof(float));
+
+    // The frames of a batch overlap, each starting one pixel further in.
+    std::vector<const uint16_t*> batch;
+    for (size_t f = 0; f < frames; f++) {
+        batch.push_back(in.data() + 1 + f);
+    }
+    std::vector<uint32_t> want_sum(n + 1), got_sum(n + 1);
+    scalar_kernels.sum_frames(batch.data(), frames, want_sum.data() + 1, n);
+    k.sum_frames(batch.data(), frames, got_sum.data() + 1, n);
+    same = same && !memcmp(want_sum.data(), got_sum.data(), got_sum.size() * sizeof(uint32_t));
+
+    scalar_kernels.add_sums(want_sum.data() + 1, want_acc.data() + 1, n);
+    k.add_sums(want_sum.data() + 1, got_acc.data() + 1, n);
+    same = same && !memcmp(want_acc.data(), got_acc.data(), got_acc.size() * sizeof(double));
+    return same;
+}
@@ -1,12 +1,12 @@
 #include "envicamera.h"
+#include "envidecode.h"
 
 ENVICamera::ENVICamera(int frWidth,
                        int frHeight,
                        int dataHeight,
                        QObject *parent) :
     CameraModel(parent), framesize(frWidth * dataHeight),
-    curIndex(0), nFrames(0), chunkFrames(32), framesRead(0),
-    tmoutPeriod(100) // milliseconds
+    nFrames(0), chunkFrames(32), next_frame(0), advised_at(0), no_data(true)
 {
     frame_width = frWidth;
     frame_height = frHeight;
@@ -16,32 +16,29 @@ ENVICamera::ENVICamera(int frWidth,
 
     dummy.resize(size_t(framesize));
     std::fill(dummy.begin(), dummy.end(), 0);
+    temp_frame.resize(size_t(framesize));
+    bip_line.resize(size_t(framesize));
 }
 
 ENVICamera::~ENVICamera()
 {
     running.store(false);
     emit timeout();
-    is_reading = false;
-    readLoopFuture.waitForFinished();
+    std::lock_guard<std::mutex> lock(map_lock);
+    data_map.close();
 }
 
 void ENVICamera::setDir(const char *filename)
 {
-
     qDebug() << filename;
-    // Close out the last file stream
-    if (is_reading) {
-        is_reading = false;
-        readLoopFuture.waitForFinished();
-    }
-    if (dev_p.is_open()) {
-        dev_p.close();
-        dev_p.clear();
-    }
+    // Close out the last file. Waiting on the lock guarantees no frame is leased out of it.
+    std::lock_guard<std::mutex> lock(map_lock);
+    data_map.close();
 
     ifname = filename;
-    framesRead = 0;
+    next_frame = 0;
+    current_frame.store(-1);
+    nFrames = 0;
 
     // Guess the ENVI header name based on file extension replacement
     std::string hdr_fname;
@@ -70,22 +67,71 @@ void ENVICamera::setDir(const char *filename)
         }
     }
 
-    dev_p.open(ifname, std::ios::in | std::ios::binary);
-    if (!dev_p.is_open()) {
-        qDebug("Could not open file. Does it exist?");
-        dev_p.clear();
+    if (!data_map.open(ifname)) {
         if (running.load()) {
             running.store(false);
             emit timeout();
+        }
+        return;
+    }
+
+    // Trust the file over the header if the recording was cut short.
+    const size_t frameBytes = size_t(framesize) * sampleBytes();
+    size_t available = data_map.size() > HDRData.offset ? (data_map.size() - HDRData.offset) / frameBytes : 0;
+    if (size_t(nFrames) > available) {
+        qDebug() << "Header reports" << nFrames << "lines but the file only holds" << available;
+        if (HDRData.interleave == fwBSQ) {
+            // The band planes of a truncated BSQ file can't be located, so don't guess.
+            data_map.close();
+            running.store(false);
+            emit timeout();
             return;
         }
+        nFrames = int(available);
+    }
+
+    if (play_dir.load() < 0) {
+        next_frame = nFrames - 1;
     }
+    data_map.adviseSequential();
+    adviseWindow();
 
-    is_reading = true;
     running.store(true);
     emit started();
+}
+
+bool ENVICamera::seek(int64_t frame)
+{
+    std::lock_guard<std::mutex> lock(map_lock);
+    if (!data_map.isOpen() || nFrames == 0) {
+        return false;
+    }
+    next_frame = std::min<int64_t>(std::max<int64_t>(frame, 0), nFrames - 1);
+    adviseWindow();
+    resume();
+    return true;
+}
+
+void ENVICamera::setPlayDirection(int dir)
+{
+    std::lock_guard<std::mutex> lock(map_lock);
+    CameraModel::setPlayDirection(dir);
+    if (current_frame.load() >= 0) {
+        next_frame = current_frame.load() + play_dir.load();
+    }
+    if (data_map.isOpen() && next_frame >= 0 && next_frame < nFrames) {
+        adviseWindow();
+        resume();
+    }
+}
 
-    readLoopFuture = QtConcurrent::run(this, &ENVICamera::readLoop);
+void ENVICamera::resume()
+{
+    // Playback that ran off either end of the file picks up again after a seek.
+    if (!running.load()) {
+        running.store(true);
+        emit started();
+    }
 }
 
 bool ENVICamera::readHeader(std::string hdr_fname)
@@ -100,7 +146,9 @@ bool ENVICamera::readHeader(std::string hdr_fname)
     HDRData.lines = 0;
     HDRData.samples = 0;
     HDRData.bands = 0;
-    HDRData.nbits = 0;
+    HDRData.data_type = envi::DT_UINT16;
+    HDRData.big_endian = false;
+    HDRData.offset = 0;
     HDRData.interleave = fwBIL;
 
     for (std::string line; std::getline(infile, line); ) {
@@ -124,7 +172,11 @@ bool ENVICamera::readHeader(std::string hdr_fname)
                 HDRData.interleave = fwBSQ;
             }
         } else if (lineData[0].compare("data type") == 0) {
-            HDRData.nbits = std::stoi(lineData[1]);
+            HDRData.data_type = std::stoi(lineData[1]);
+        } else if (lineData[0].compare("byte order") == 0) {
+            HDRData.big_endian = std::stoi(lineData[1]) == 1;
+        } else if (lineData[0].compare("header offset") == 0) {
+            HDRData.offset = size_t(std::stoul(lineData[1]));
         }
     }
 
@@ -133,53 +185,160 @@ bool ENVICamera::readHeader(std::string hdr_fname)
         qDebug("Frame geometry of input ENVI file does not match specified geometry.");
         qDebug() << "Please restart LiveView with a geometry of" << HDRData.samples << "by" << HDRData.bands;
         return false;
-    } else if (HDRData.interleave != fwBIL) {
-        // fite meeeee ヽ(´ー｀)┌
-        qDebug("Only BIL bit organization is currently supported. Please bother Jackie to make a decoder.");
+    }
+    if (!envi::isSupported(HDRData.data_type)) {
+        qDebug() << "ENVI data type" << HDRData.data_type << "is not supported. Supported types are 1, 2, 3, 4 and 12.";
         return false;
     }
     return true;
 }
 
-void ENVICamera::readLoop()
+void ENVICamera::adviseWindow()
 {
-    QTime remTime;
-    std::vector<uint16_t> copy_vec(size_t(framesize), 0);
-    do {
-        // Yeah yeah whatever it's a magic number/buffer size recommendation
-        if (frame_buf.size() <= 96) {
-            if (framesRead >= nFrames) {
-                // drops out of the loop
-                is_reading = false;
-                continue;
-            }
-            int nextFrames = framesRead + chunkFrames > nFrames ? nFrames - framesRead : chunkFrames;
+    // Ask for the next few chunks in the direction of play. When playing forward, also let go
+    // of what fell more than a chunk behind the cursor since the last time, at most as much as
+    // could have been read ahead. The leased frame is never dropped.
+    const int64_t ahead = 4 * chunkFrames;
+    const int64_t first = play_dir.load() > 0 ? next_frame : std::max<int64_t>(0, next_frame + 1 - ahead);
+    const int64_t last = std::min<int64_t>(nFrames, first + ahead);
+    const int64_t behind = play_dir.load() > 0 ? next_frame - chunkFrames : 0;
+    const int64_t dropped = std::max<int64_t>(std::max(advised_at - chunkFrames, behind - ahead), 0);
+    advised_at = next_frame;
+    if (first >= last) {
+        return;
+    }
 
-            for (int n = 0; n < nextFrames; ++n) {
-                dev_p.read(reinterpret_cast<char*>(copy_vec.data()), framesize * int(sizeof(uint16_t)));
-                frame_buf.emplace_front(copy_vec);
+    const size_t frameBytes = size_t(framesize) * sampleBytes();
+    if (HDRData.interleave != fwBSQ) {
+        data_map.willNeed(HDRData.offset + size_t(first) * frameBytes, size_t(last - first) * frameBytes);
+        if (behind > dropped) {
+            data_map.dontNeed(HDRData.offset + size_t(dropped) * frameBytes, size_t(behind - dropped) * frameBytes);
+        }
+    } else {
+        // In BSQ every band is its own sequential stream through the file.
+        const size_t lineBytes = size_t(frame_width) * sampleBytes();
+        const size_t bandBytes = size_t(HDRData.lines) * lineBytes;
+        for (size_t b = 0; b < size_t(frame_height); b++) {
+            const size_t band_start = HDRData.offset + b * bandBytes;
+            data_map.willNeed(band_start + size_t(first) * lineBytes, size_t(last - first) * lineBytes);
+            if (behind > dropped) {
+                data_map.dontNeed(band_start + size_t(dropped) * lineBytes, size_t(behind - dropped) * lineBytes);
             }
-            framesRead += nextFrames;
+        }
+    }
+}
+
+uint16_t* ENVICamera::nextFrame(uint16_t *slot)
+{
+    no_data = true;
+    if (!data_map.isOpen() || !running.load()) {
+        return dummy.data();
+    }
+
+    const int dir = play_dir.load();
+    const int64_t loopFirst = std::max<int64_t>(loop_first.load(), 0);
+    const int64_t loopLast = std::min<int64_t>(loop_last.load(), nFrames - 1);
+    const bool looping = loopFirst <= loopLast;
+    int64_t line = next_frame;
+    if (looping && (line < loopFirst || line > loopLast)) {
+        line = dir > 0 ? loopFirst : loopLast;
+    }
+    if (line < 0 || line >= nFrames) {
+        return dummy.data();
+    }
+
+    const size_t frameBytes = size_t(framesize) * sampleBytes();
+    uint16_t *frame = slot;
+    switch (HDRData.interleave) {
+    case fwBIL:
+    {
+        const unsigned char *src = data_map.data() + HDRData.offset + size_t(line) * frameBytes;
+        if (isNative()) {
+            // Lend out the mapped frame, FrameWorker takes the only copy.
+            frame = const_cast<uint16_t*>(reinterpret_cast<const uint16_t*>(src));
         } else {
-            remTime = QTime::currentTime().addMSecs(tmoutPeriod);
-            while(QTime::currentTime() < remTime) {
-                QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-            }
+            envi::convert_to_u16(src, slot, size_t(framesize), HDRData.data_type, needsSwap());
+        }
+        break;
+    }
+    case fwBIP:
+    {
+        // One BIP line is [samples][bands], transpose it into [bands][samples].
+        const unsigned char *src = data_map.data() + HDRData.offset + size_t(line) * frameBytes;
+        const uint16_t *bip = reinterpret_cast<const uint16_t*>(src);
+        if (!isNative()) {
+            envi::convert_to_u16(src, bip_line.data(), size_t(framesize), HDRData.data_type, needsSwap());
+            bip = bip_line.data();
+        }
+        envi::transpose_u16(bip, slot, size_t(frame_width), size_t(frame_height));
+        break;
+    }
+    case fwBSQ:
+    {
+        // Gather this line of every band, each band being a separate plane of the file.
+        const size_t lineBytes = size_t(frame_width) * sampleBytes();
+        const size_t bandBytes = size_t(HDRData.lines) * lineBytes;
+        const unsigned char *src = data_map.data() + HDRData.offset + size_t(line) * lineBytes;
+        for (size_t b = 0; b < size_t(frame_height); b++) {
+            envi::convert_to_u16(src + b * bandBytes, slot + b * size_t(frame_width),
+                                 size_t(frame_width), HDRData.data_type, needsSwap());
         }
-    } while (is_reading);
+        break;
+    }
+    }
+
+    no_data = false;
+    current_frame.store(line);
+    next_frame = line + dir;
+    if (std::abs(next_frame - advised_at) >= chunkFrames) {
+        adviseWindow();
+    }
+    if (!looping && (next_frame < 0 || next_frame >= nFrames)) {
+        running.store(false);
+        emit timeout();
+    }
+    return frame;
+}
+
+size_t ENVICamera::sampleBytes() const
+{
+    return envi::sampleSize(HDRData.data_type);
+}
+
+bool ENVICamera::needsSwap() const
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return !HDRData.big_endian;
+#else
+    return HDRData.big_endian;
+#endif
+}
+
+bool ENVICamera::isNative() const
+{
+    return HDRData.data_type == envi::DT_UINT16 && !needsSwap() &&
+            HDRData.offset % alignof(uint16_t) == 0;
 }
 
 uint16_t* ENVICamera::getFrame()
 {
-    if (!frame_buf.empty() && running.load()) {
-        temp_frame = frame_buf.back();
-        frame_buf.pop_back();
-        if (frame_buf.empty()) {
-            running.store(false);
-            emit timeout();
-        }
-        return temp_frame.data();
-    } else {
-        return dummy.data();
+    std::lock_guard<std::mutex> lock(map_lock);
+    uint16_t *frame = nextFrame(temp_frame.data());
+    if (frame != temp_frame.data() && frame != dummy.data()) {
+        memcpy(temp_frame.data(), frame, size_t(framesize) * sizeof(uint16_t));
+        frame = temp_frame.data();
     }
+    return frame;
+}
+
+uint16_t* ENVICamera::acquireFrame(uint16_t *slot)
+{
+    map_lock.lock();
+    return nextFrame(slot);
+}
+
+void ENVICamera::releaseFrame(uint16_t *frame)
+{
+    Q_UNUSED(frame);
+    map_lock.unlock();
 }
@@ -0,0 +1,287 @@
+#include "envidecode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Tiles of 64 x 64 samples (8 kB in, 8 kB out) keep both sides of the transpose in L1.
+static const size_t TRANSPOSE_BLOCK = 64;
+
+bool envi::isSupported(int data_type)
+{
+    return sampleSize(data_type) != 0;
+}
+
+size_t envi::sampleSize(int data_type)
+{
+    switch (data_type) {
+    case DT_UINT8: return 1;
+    case DT_INT16: return 2;
+    case DT_INT32: return 4;
+    case DT_FLOAT32: return 4;
+    case DT_UINT16: return 2;
+    default: return 0;
+    }
+}
+
+template <typename T>
+static inline T load_sample(const unsigned char *src, size_t ndx, bool swap_bytes)
+{
+    T value;
+    if (swap_bytes) {
+        unsigned char bytes[sizeof(T)];
+        for (size_t b = 0; b < sizeof(T); b++) {
+            bytes[b] = src[ndx * sizeof(T) + sizeof(T) - 1 - b];
+        }
+        memcpy(&value, bytes, sizeof(T));
+    } else {
+        memcpy(&value, src + ndx * sizeof(T), sizeof(T));
+    }
+    return value;
+}
+
+static inline uint16_t saturate_u16(int64_t value)
+{
+    return static_cast<uint16_t>(std::min<int64_t>(65535, std::max<int64_t>(0, value)));
+}
+
+static inline uint16_t saturate_u16(float value)
+{
+    if (!(value > 0.0f)) { // also catches NaN
+        return 0;
+    }
+    return static_cast<uint16_t>(std::nearbyint(std::min(value, 65535.0f)));
+}
+
+void envi::convert_to_u16_scalar(const unsigned char *src, uint16_t *dst, size_t n,
+                                 int data_type, bool swap_bytes)
+{
+    switch (data_type) {
+    case DT_UINT8:
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = src[i];
+        }
+        break;
+    case DT_INT16:
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = saturate_u16(int64_t(load_sample<int16_t>(src, i, swap_bytes)));
+        }
+        break;
+    case DT_INT32:
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = saturate_u16(int64_t(load_sample<int32_t>(src, i, swap_bytes)));
+        }
+        break;
+    case DT_FLOAT32:
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = saturate_u16(load_sample<float>(src, i, swap_bytes));
+        }
+        break;
+    case DT_UINT16:
+        if (!swap_bytes) {
+            memcpy(dst, src, n * sizeof(uint16_t));
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = load_sample<uint16_t>(src, i, true);
+            }
+        }
+        break;
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128i load128(const unsigned char *src)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+}
+
+static inline void store128(uint16_t *dst, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+}
+
+static inline __m128i bswap16(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i bswap32(__m128i v)
+{
+    // Swap the 16-bit halves of each 32-bit lane, then the bytes within each half.
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return bswap16(v);
+}
+
+// Pack two vectors of int32 already clamped to [0, 65535] into one vector of uint16. SSE2 only
+// has a signed saturating pack, so bias into the int16 range and flip the sign bit back.
+static inline __m128i pack_u32_u16(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+    __m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+    return _mm_xor_si128(packed, _mm_set1_epi16(-32768));
+}
+
+static inline __m128i clamp_i32(__m128i v)
+{
+    const __m128i max = _mm_set1_epi32(65535);
+    v = _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_setzero_si128()));
+    __m128i over = _mm_cmpgt_epi32(v, max);
+    return _mm_or_si128(_mm_andnot_si128(over, v), _mm_and_si128(over, max));
+}
+
+static inline __m128i clamp_round_f32(__m128i bits)
+{
+    // max_ps returns its second operand when the first is NaN, so NaN becomes 0 here.
+    __m128 v = _mm_max_ps(_mm_castsi128_ps(bits), _mm_setzero_ps());
+    v = _mm_min_ps(v, _mm_set1_ps(65535.0f));
+    return _mm_cvtps_epi32(v); // rounds to nearest even, same as nearbyint
+}
+#endif
+
+void envi::convert_to_u16(const unsigned char *src, uint16_t *dst, size_t n,
+                          int data_type, bool swap_bytes)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    switch (data_type) {
+    case DT_UINT8:
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = load128(src + i);
+            store128(dst + i, _mm_unpacklo_epi8(v, zero));
+            store128(dst + i + 8, _mm_unpackhi_epi8(v, zero));
+        }
+        break;
+    case DT_INT16:
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = load128(src + 2 * i);
+            if (swap_bytes) {
+                v = bswap16(v);
+            }
+            store128(dst + i, _mm_max_epi16(v, zero));
+        }
+        break;
+    case DT_INT32:
+        for (; i + 8 <= n; i += 8) {
+            __m128i lo = load128(src + 4 * i);
+            __m128i hi = load128(src + 4 * i + 16);
+            if (swap_bytes) {
+                lo = bswap32(lo);
+                hi = bswap32(hi);
+            }
+            store128(dst + i, pack_u32_u16(clamp_i32(lo), clamp_i32(hi)));
+        }
+        break;
+    case DT_FLOAT32:
+        for (; i + 8 <= n; i += 8) {
+            __m128i lo = load128(src + 4 * i);
+            __m128i hi = load128(src + 4 * i + 16);
+            if (swap_bytes) {
+                lo = bswap32(lo);
+                hi = bswap32(hi);
+            }
+            store128(dst + i, pack_u32_u16(clamp_round_f32(lo), clamp_round_f32(hi)));
+        }
+        break;
+    case DT_UINT16:
+        if (!swap_bytes) {
+            memcpy(dst, src, n * sizeof(uint16_t));
+            return;
+        }
+        for (; i + 8 <= n; i += 8) {
+            store128(dst + i, bswap16(load128(src + 2 * i)));
+        }
+        break;
+    }
+#endif
+    // Whatever did not fill a whole vector
+    convert_to_u16_scalar(src + i * sampleSize(data_type), dst + i, n - i, data_type, swap_bytes);
+}
+
+void envi::transpose_u16_scalar(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols)
+{
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            dst[c * rows + r] = src[r * cols + c];
+        }
+    }
+}
+
+#ifdef __SSE2__
+static inline void transpose_8x8(const uint16_t *src, size_t src_stride,
+                                 uint16_t *dst, size_t dst_stride)
+{
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0 * src_stride));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1 * src_stride));
+    __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * src_stride));
+    __m128i a3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * src_stride));
+    __m128i a4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * src_stride));
+    __m128i a5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 5 * src_stride));
+    __m128i a6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 6 * src_stride));
+    __m128i a7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 7 * src_stride));
+
+    // Interleave 16-bit pairs, then 32-bit pairs, then 64-bit halves.
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    __m128i b4 = _mm_unpacklo_epi16(a4, a5);
+    __m128i b5 = _mm_unpackhi_epi16(a4, a5);
+    __m128i b6 = _mm_unpacklo_epi16(a6, a7);
+    __m128i b7 = _mm_unpackhi_epi16(a6, a7);
+
+    __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+    __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+    __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+    __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+    __m128i c4 = _mm_unpacklo_epi32(b4, b6);
+    __m128i c5 = _mm_unpackhi_epi32(b4, b6);
+    __m128i c6 = _mm_unpacklo_epi32(b5, b7);
+    __m128i c7 = _mm_unpackhi_epi32(b5, b7);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0 * dst_stride), _mm_unpacklo_epi64(c0, c4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 1 * dst_stride), _mm_unpackhi_epi64(c0, c4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * dst_stride), _mm_unpacklo_epi64(c1, c5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * dst_stride), _mm_unpackhi_epi64(c1, c5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * dst_stride), _mm_unpacklo_epi64(c2, c6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 5 * dst_stride), _mm_unpackhi_epi64(c2, c6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 6 * dst_stride), _mm_unpacklo_epi64(c3, c7));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 7 * dst_stride), _mm_unpackhi_epi64(c3, c7));
+}
+#endif
+
+void envi::transpose_u16(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols)
+{
+    for (size_t rb = 0; rb < rows; rb += TRANSPOSE_BLOCK) {
+        const size_t r_end = std::min(rows, rb + TRANSPOSE_BLOCK);
+        for (size_t cb = 0; cb < cols; cb += TRANSPOSE_BLOCK) {
+            const size_t c_end = std::min(cols, cb + TRANSPOSE_BLOCK);
+            size_t r = rb;
+#ifdef __SSE2__
+            for (; r + 8 <= r_end; r += 8) {
+                size_t c = cb;
+                for (; c + 8 <= c_end; c += 8) {
+                    transpose_8x8(src + r * cols + c, cols, dst + c * rows + r, rows);
+                }
+                // Columns left over at the right edge of the block
+                for (; c < c_end; c++) {
+                    for (size_t rr = r; rr < r + 8; rr++) {
+                        dst[c * rows + rr] = src[rr * cols + c];
+                    }
+                }
+            }
+#endif
+            // Rows left over at the bottom edge of the block
+            for (; r < r_end; r++) {
+                for (size_t c = cb; c < c_end; c++) {
+                    dst[c * rows + r] = src[r * cols + c];
+                }
+            }
+        }
+    }
+}
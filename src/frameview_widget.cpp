@@ -162,8 +162,8 @@ frameview_widget::frameview_widget(FrameWorker *fw,
     /* In the dark subtraction mode, add an additional checkbox
      * at the bottom of the pane that allows the user to toggle
      * whether to display the dark subtracted data or the SNR
-     * data. The SNR calculation is performed in the
-     * FrameWorker::captureSDFrames loop function.
+     * data. The SNR calculation is performed by the "snr"
+     * processing stage, see lvstages.cpp.
      */
     if (image_type == DSF) { //Dark Sub Widget Only
         QCheckBox *plotModeCheckbox =
@@ -1,91 +1,83 @@
 #include "frameworker.h"
+#include "lvframebuffer.h"
+#include "lvstage.h"
+#include "osutils.h"
+#include "stagegraph.h"
+#include "workstealpool.h"
 #include "unistd.h"
 
-class LVFrameBuffer
-{
-public:
-    LVFrameBuffer(const int num_frames, const int frame_width, const int frame_height)
-        : lastIndex(0), fbIndex(0),  dsfIndex(0), stdIndex(0)
-    {
-        for (int f = 0; f < num_frames; ++f) {
-            auto pFrame = new LVFrame(frame_width, frame_height);
-            frame_vec.push_back(pFrame);
-        }
-    }
-    ~LVFrameBuffer()
-    {
-        for(auto &elem : frame_vec) {
-            delete elem;
-            elem = nullptr;
-        }
-        frame_vec.clear();
-        std::vector<LVFrame*>(frame_vec).swap(frame_vec);
-        Q_ASSERT(frame_vec.capacity() == 0);
-        qDebug() << "LVFrameBuffer Destruct";
-    }
-    void reset(const int num_frames, const int frame_width, const int frame_height)
-    {
-        for(auto &elem : frame_vec) {
-            delete elem;
-            elem = nullptr;
-        }
-        frame_vec.clear();
-        std::vector<LVFrame*>(frame_vec).swap(frame_vec);
-        for (int f = 0; f < num_frames; ++f) {
-            auto pFrame = new LVFrame(frame_width, frame_height);
-            frame_vec.push_back(pFrame);
-        }
-        fbIndex.store(0, std::memory_order_release);
-    }
-
-    size_t size() const { return frame_vec.size(); }
+#include <cmath>
 
-    LVFrame* frame(uint16_t i) { return frame_vec.at(i); }
-    LVFrame* current() { return frame_vec.at(uint32_t(fbIndex.load())); }
-    LVFrame* recent() { return frame_vec.at(uint32_t(lastIndex.load())); }
-    LVFrame* lastDSF() { return frame_vec.at(uint32_t(dsfIndex.load())); }
-    LVFrame* lastSTD() { return frame_vec.at(uint32_t(stdIndex.load())); }
-
-    std::atomic<int> lastIndex;
-    std::atomic<int> fbIndex;
-    std::atomic<int> dsfIndex;
-    std::atomic<int> stdIndex;
-
-public slots:
-    inline void incIndex()
-    {
-        lastIndex.store(fbIndex, std::memory_order_release);
-        if (++fbIndex == static_cast<int>(frame_vec.size())) {
-            fbIndex.store(0, std::memory_order_release);
-        }
-    }
-    inline void setDSF(int f_num) { dsfIndex.store(f_num, std::memory_order_release); }
-    inline void setSTD(int f_num) { stdIndex.store(f_num, std::memory_order_release); }
-private:
-    std::vector<LVFrame*> frame_vec;
-};
-
-FrameWorker::FrameWorker(QSettings *settings_arg, QThread *worker, QObject *parent)
+FrameWorker::FrameWorker(QSettings *settings_arg, WorkStealingPool *pool, QThread *worker, QObject *parent)
     : QObject(parent), settings(settings_arg),
-      thread(worker), plotMode(LV::pmRAW), saving(false),
+      thread(worker), lvframe_buffer(nullptr), paused(false), steps_pending(0), plotMode(LV::pmRAW), saving(false),
       count(0), count_prev(0), frame_period_ms(25.0)
 {
     pixRemap = settings->value(QString("pix_remap"), false).toBool();
     is16bit = settings->value(QString("remap16"), false).toBool();
     interlace = settings->value(QString("interlace"), false).toBool();
+    stage_pool = pool;
+    stage_graph = nullptr;
+    resetStageStats();
+    display_seq.store(0);
+    ring_budget_mb.store(settings->value(QString("ring_budget_mb"), 1024).toInt());
+    ring_slack_ms.store(settings->value(QString("ring_slack_ms"), 2000).toInt());
+    ring_hold.store(false);
+    ring_users.store(0);
+    mask_lossless = settings->value(QString("mask_lossless"), false).toBool();
+    mask_collecting.store(false);
+
+    // Thread placement, as CPU lists like "0-3,8". Empty leaves the scheduler to it.
+    acquisition_cpus = os::parseCpuList(settings->value(QString("affinity_acquisition"), "").toString().toStdString());
+    processing_cpus = os::parseCpuList(settings->value(QString("affinity_processing"), "").toString().toStdString());
+    io_cpus = os::parseCpuList(settings->value(QString("affinity_io"), "").toString().toStdString());
+    ring_node = settings->value(QString("numa_node"), -1).toInt();
+    if (ring_node < 0 && !acquisition_cpus.empty()) {
+        // The ring belongs next to the thread that fills it.
+        ring_node = os::cpuNode(acquisition_cpus.front());
+    }
+    pacer.setPeriod(frame_period_ms);
+    pacer.setMode(pace_mode_t(settings->value(QString("playback_pacing"), PACE_FIXED).toInt()));
     Camera = nullptr;
 
     switch(static_cast<source_t>(settings->value(QString("cam_model")).toInt())) {
     case XIO:
         Camera = new XIOCamera(settings->value(QString("ssd_width"), 640).toInt(),
                                settings->value(QString("ssd_height"), 480).toInt(),
-                               settings->value(QString("ssd_height"), 480).toInt());
+                               settings->value(QString("ssd_height"), 480).toInt(),
+                               settings->value(QString("xio_io_depth"), 4).toInt(),
+                               settings->value(QString("xio_readahead_mb"), 256).toInt());
         break;
     case ENVI:
         Camera = new ENVICamera(settings->value(QString("ssd_width"), 640).toInt(),
                                 settings->value(QString("ssd_height"), 480).toInt(),
                                 settings->value(QString("ssd_height"), 480).toInt());
         break;
+    case SIM:
+        Camera = new SimCamera(settings->value(QString("ssd_width"), 640).toInt(),
+                               settings->value(QString("ssd_height"), 480).toInt(),
+                               settings->value(QString("ssd_height"), 480).toInt(),
+                               static_cast<sim_pattern_t>(settings->value(QString("sim_pattern"), SIM_RAMP).toInt()),
+                               settings->value(QString("sim_fps"), 0.0).toDouble(),
+                               settings->value(QString("sim_noise_sigma"), 16.0).toDouble(),
+                               settings->value(QString("sim_defects"), false).toBool(),
+                               settings->value(QString("sim_seed"), 0x4C56).toUInt());
+        break;
+    case SHM:
+        Camera = new ShmCamera(settings->value(QString("shm_name"), "/liveview_ring").toString().toStdString(),
+                               settings->value(QString("shm_timeout_ms"), 1000).toInt());
+        break;
+    case NET:
+        Camera = new NetCamera(settings->value(QString("ssd_width"), 640).toInt(),
+                               settings->value(QString("ssd_height"), 480).toInt(),
+                               settings->value(QString("ssd_height"), 480).toInt(),
+                               static_cast<net_proto_t>(settings->value(QString("net_protocol"), NET_UDP).toInt()),
+                               settings->value(QString("net_bind"), "0.0.0.0").toString().toStdString(),
+                               settings->value(QString("net_port"), 50010).toInt(),
+                               settings->value(QString("net_pool_frames"), 8).toInt(),
+                               settings->value(QString("net_rcvbuf_mb"), 32).toInt(),
+                               settings->value(QString("net_timeout_ms"), 1000).toInt());
+        break;
     case CAMERA_LINK:
 #ifdef USE_EDT
         Camera = new CLCamera();
@@ -130,9 +122,10 @@ FrameWorker::FrameWorker(QSettings *settings_arg, QThread *worker, QObject *pare
     }
 
     frSize = size_t(frWidth * dataHeight);
-    lvframe_buffer = new LVFrameBuffer(CPU_FRAME_BUFFER_SIZE, frWidth, dataHeight);
-    TwosFilter = new TwosComplimentFilter(size_t(frSize));
-    IlaceFilter = new InterlaceFilter(size_t(frHeight), size_t(frWidth));
+    ring_target.store(ringDepthFor(0.0));
+    lvframe_buffer = new LVFrameBuffer(ring_target.load(), frWidth, dataHeight, PRODUCT_RING_SIZE, ring_node);
+    InFilter = new IngestFilter(size_t(frHeight), size_t(frWidth), size_t(dataHeight),
+                                settings->value(QString("interlace_taps"), 4).toInt());
     DSFilter = new DarkSubFilter(size_t(frSize));
     stddev_N = MAX_N; // arbitrary starting point
     STDFilter = new StdDevFilter(frWidth, dataHeight, stddev_N);
@@ -148,6 +141,8 @@ FrameWorker::FrameWorker(QSettings *settings_arg, QThread *worker, QObject *pare
 
     isTimeout = false;
 
+    buildStages();
+
     connect(this, &FrameWorker::doneSaving, this, [&]()
     {
         if (!SaveQueue.empty()) {
@@ -163,11 +158,14 @@ FrameWorker::FrameWorker(QSettings *settings_arg, QThread *worker, QObject *pare
 FrameWorker::~FrameWorker()
 {
     isRunning = false;
+    // The stages use the filters, let them finish first. The pool carries on for the other sources.
+    delete stage_graph;
+    mask_loop.waitForFinished();
+    ring_prep.waitForFinished();
     delete STDFilter;
     delete MEFilter;
     delete DSFilter;
-    delete TwosFilter;
-    delete IlaceFilter;
+    delete InFilter;
     delete Camera;
 }
 
@@ -175,6 +173,9 @@ void FrameWorker::stop()
 {
     qDebug("Stopping frame acquistion.");
     isRunning = false;
+    if (lvframe_buffer) {
+        lvframe_buffer->wakeAll();
+    }
     emit finished();
 }
 
@@ -197,36 +198,66 @@ void FrameWorker::reportTimeout()
 void FrameWorker::captureFrames()
 {
     qDebug("About to start capturing frames");
-    high_resolution_clock::time_point beg, end;
+    pinTo(acquisition_cpus, "acquisition");
+    high_resolution_clock::time_point end;
     high_resolution_clock::time_point last_frame;
-    int64_t duration;
     double this_frame_duration;
     ticklist.fill(0);
 
     auto fpsclock = new QTimer();
     connect(fpsclock, &QTimer::timeout, this, &FrameWorker::reportFPS);
     fpsclock->start(1000);
+    pacer.reset();
 
     while (isRunning) {
-        beg = high_resolution_clock::now();
-        uint16_t* temp_frame = Camera->getFrame();
-        for (int pix = 0; pix < int(frSize); pix++) {
-            lvframe_buffer->current()->raw_data[pix] = temp_frame[pix];
+        if (ring_hold.load() || ring_target.load() != int(lvframe_buffer->size())) {
+            resizeRing();
         }
-
-        //lvframe_buffer->current()->raw_data = Camera->getFrame();
-
-        if (pixRemap) {// if (Camera->isRunning() && pixRemap) {
-            TwosFilter->apply_filter(lvframe_buffer->current()->raw_data, is16bit);
+        if (paused.load() && steps_pending.load() == 0) {
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+            usleep(FRAME_DISPLAY_PERIOD_MSECS * 1000);
+            continue;
         }
-        if (interlace) {
-            IlaceFilter->apply_filter(lvframe_buffer->current()->raw_data);
+        // Readers still copying out the frame this slot held will notice it changing under them.
+        lvframe_buffer->current()->beginWrite();
+        uint16_t *slot = lvframe_buffer->current()->raw_data;
+        // Sources that decode in place return the slot itself, otherwise they lend us
+        // a buffer they own and we take the one unavoidable copy into the ring.
+        uint16_t *leased = Camera->acquireFrame(slot);
+        LVFrameMeta &meta = lvframe_buffer->current()->meta;
+        meta.mono_ns = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        meta.host_ns = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        if (dataHeight > frHeight) {
+            // The camera sends a header row below the image, keep its leading words at hand,
+            // as they came before any remapping.
+            meta.header_words = uint16_t(std::min(frWidth, META_HEADER_WORDS));
+            memcpy(meta.header, leased + size_t(frHeight * frWidth), meta.header_words * sizeof(uint16_t));
+        } else {
+            meta.header_words = 0;
         }
+        // One pass from the source's buffer into the slot, remapped and deinterlaced on the
+        // way. Sources that decoded into the slot are filtered in place.
+        InFilter->apply_filter(leased, slot, pixRemap, is16bit, interlace);
+        // Release before asking about the frame, sources that lend out memory they do not
+        // own (e.g. shared memory) only know whether the copy was intact afterwards.
+        Camera->releaseFrame(leased);
+        meta.source_ns = Camera->frameTimestamp();
+        meta.source_frame = Camera->isSeekable() ? Camera->currentFrame() : -1;
+        meta.status = Camera->frameStatus();
+
         end = high_resolution_clock::now();
 
+        meta.seq = uint64_t(count.load()) + 1;
+        lvframe_buffer->current()->seq.store(meta.seq, std::memory_order_release);
+        lvframe_buffer->current()->endWrite();
+        // Count the frame before incIndex() wakes the loops, they go by count.
+        count++;
         lvframe_buffer->incIndex();
+        stage_processed[STAGE_INGEST]++;
+        if (steps_pending.load() > 0) {
+            steps_pending--;
+        }
 
-        duration = duration_cast<milliseconds>(end - beg).count();
         this_frame_duration = duration_cast<microseconds>(end - last_frame).count();
         last_frame = end;
         ticksum -= ticklist.at(size_t(tickindex));
@@ -236,70 +267,77 @@ void FrameWorker::captureFrames()
             tickindex = 0;
         }
 
-        count++;
-        if (duration < frame_period_ms && (cam_type == SSD_XIO || cam_type == SSD_ENVI)) {
-            delay(int64_t(frame_period_ms) - duration);
-        } else {
-            QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+        if (cam_type == SSD_XIO || cam_type == SSD_ENVI) {
+            pacer.wait(meta.source_ns);
         }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
     }
+    // A resize left waiting for the readers will never happen now.
+    releaseRing();
 }
 
-void FrameWorker::captureDSFrames()
+void FrameWorker::processFrames()
 {
-    int64_t count_framestart;
-    uint16_t store_point;
-    int64_t last_complete = 1;
+    int64_t last_submitted = -1;
 
     while (isRunning) {
-        count_framestart = int64_t(count.load()) - 1;
-        if (last_complete < count_framestart) {
-            store_point = count_framestart % CPU_FRAME_BUFFER_SIZE;
-            DSFilter->dsf_callback(lvframe_buffer->frame(store_point)->raw_data, lvframe_buffer->frame(store_point)->dsf_data);
-            MEFilter->compute_mean(lvframe_buffer->frame(store_point), topLeft,
-                                   bottomRight, plotMode, Camera->isRunning());
-            lvframe_buffer->setDSF(store_point);
-            last_complete = count_framestart;
+        const uint64_t seen = lvframe_buffer->arrivalCount();
+        const int64_t newest = int64_t(count.load()) - 1;
+        if (last_submitted < newest && enterRing()) {
+            // Everything ingested since the last pass goes past the stages in favour of the newest frame.
+            stage_graph->skip(uint64_t(newest - last_submitted - 1));
+            const uint16_t store_point = uint16_t(newest % int64_t(lvframe_buffer->size()));
+            // The pass keeps the ring entered until its last stage is done.
+            if (!stage_graph->submit(uint64_t(newest) + 1, store_point, [this]() { leaveRing(); })) {
+                leaveRing();
+            }
+            last_submitted = newest;
         } else {
-            usleep(FRAME_DISPLAY_PERIOD_MSECS * 1000);
+            lvframe_buffer->waitForFrame(seen, milliseconds(LOOP_IDLE_TIMEOUT_MS));
         }
     }
+    stage_graph->close();
 }
 
-void FrameWorker::captureSDFrames()
+void FrameWorker::buildStages()
 {
-    int64_t count_framestart;
-    uint16_t store_point;
-    int64_t last_complete = 0;
-
-    while (isRunning) {
-        count_framestart = int64_t(count.load()) - 1;
-        if (last_complete < count_framestart && STDFilter->isReadyRead()) {
-            store_point = count_framestart % CPU_FRAME_BUFFER_SIZE;
-            STDFilter->compute_stddev(lvframe_buffer->frame(store_point), stddev_N);
-            // Move the read point in the buffer only if the data is "valid"
-            if (STDFilter->isReadyDisplay()) {
-                lvframe_buffer->setSTD(store_point);
-                compute_snr(lvframe_buffer->frame(store_point));
-            }
-            last_complete = count_framestart;
-        } else {
-            usleep(useconds_t(frame_period_ms) * 1000);
+    // By default everything that registered itself runs.
+    QStringList names;
+    for (auto &name : StageRegistry::instance().names()) {
+        names << QString::fromStdString(name);
+    }
+    names = settings->value(QString("stages"), names).toStringList();
+    names.removeDuplicates();
+
+    // Only this source's passes, they run on the pool that all sources share.
+    stage_graph = new StageGraph(stage_pool);
+    for (auto &name : names) {
+        LVStage *stage = StageRegistry::instance().create(name.toStdString(), this);
+        if (!stage) {
+            qWarning("Unknown processing stage \"%s\", leaving it out.", qPrintable(name));
+            continue;
         }
+        stage_graph->add(name.toStdString(), stage);
     }
+    stage_graph->build();
 }
 
 void FrameWorker::saveFrames(save_req_t req)
 {
     emit startSaving();
     saving = true;
+    std::vector<int> pool_cpus = pinTo(io_cpus, "recorder");
+    // The frames queued up below are pointers into the ring, it keeps its depth until we are done.
+    waitRing();
     int64_t next_frame = count.load();
+    int64_t write_frame = next_frame; // frame number at the front of frame_fifo
     int64_t new_count = 0;
     std::vector<uint16_t> p_frame;
     std::string hdr_fname;
     save_count.store(0);
 
     std::vector<float> frame_accum;
+    int accum_frames = 0;
     if (req.nAvgs > 1) {
         frame_accum.resize(frSize);
         std::fill(frame_accum.begin(), frame_accum.end(), 0.0);
@@ -311,6 +349,18 @@ void FrameWorker::saveFrames(save_req_t req)
         hdr_fname = req.file_name + ".hdr";
     }
 
+    // One line of frame metadata per saved frame, next to the data file.
+    std::ofstream meta_file;
+    if (settings->value(QString("save_metadata"), true).toBool()) {
+        std::string meta_fname = hdr_fname.substr(0, hdr_fname.size() - 3) + "meta.csv";
+        meta_file.open(meta_fname);
+        if (meta_file.is_open()) {
+            meta_file << "line,seq,mono_ns,host_ns,source_ns,source_frame,status,header\n";
+        } else {
+            qDebug().nospace() << "Could not open file " << meta_fname.c_str() << ". Frame metadata will not be saved.";
+        }
+    }
+
     switch(req.bit_org) {
     case fwBIL:
         p_getSaveFrame = &FrameWorker::getBILSaveFrame;
@@ -322,30 +372,57 @@ void FrameWorker::saveFrames(save_req_t req)
         p_getSaveFrame = &FrameWorker::getBILSaveFrame; // BSQ conversion is done at the end.
     }
 
+    const int64_t depth = int64_t(lvframe_buffer->size());
     std::ofstream p_file;
     p_file.open(req.file_name, std::ofstream::binary);
     while (save_count.load() < req.nFrames) {
         new_count = count.load();
         for (int f = 0; f < new_count - next_frame; f++) {
-            frame_fifo.push(lvframe_buffer->frame((next_frame + f) % CPU_FRAME_BUFFER_SIZE)->raw_data);
+            frame_fifo.push(lvframe_buffer->frame(uint16_t((next_frame + f) % depth))->raw_data);
         }
         next_frame = new_count;
         if (!frame_fifo.empty()) {
+            LVFrame *source = lvframe_buffer->frame(uint16_t(write_frame % depth));
+            const uint32_t version = source->readBegin();
             p_frame = (this->*p_getSaveFrame)(); // frame_fifo.front();
+            LVFrameMeta meta = source->meta;
+            // If the ring has come back around onto this slot, what we copied is (part of) a
+            // newer frame. It goes into the file as a blank frame, flagged in the metadata.
+            const bool intact = source->readValid(version) && meta.seq == uint64_t(write_frame) + 1;
+            if (intact) {
+                stage_processed[STAGE_SAVE]++;
+            } else {
+                stage_skipped[STAGE_SAVE]++;
+                std::fill(p_frame.begin(), p_frame.end(), 0);
+                memset(&meta, 0, sizeof(meta));
+                meta.seq = uint64_t(write_frame) + 1;
+                meta.source_ns = -1;
+                meta.source_frame = -1;
+                meta.status = FRAME_OVERRUN | FRAME_NO_DATA;
+            }
+            if (meta_file.is_open()) {
+                writeMeta(meta_file, save_count.load() / uint_fast32_t(std::max<int64_t>(req.nAvgs, 1)), meta);
+            }
+            write_frame++;
             if (req.nAvgs <= 1) {
                 p_file.write(reinterpret_cast<char*>(p_frame.data()),
                              std::streamsize(frSize * sizeof(uint16_t)));
             } else {
                 if (save_count % req.nAvgs == 0) {
+                    // Lost frames are left out of the mean rather than counted as zeros.
                     for (size_t p = 0; p < frSize; p++) {
-                        frame_accum[p] /= static_cast<float>(req.nAvgs);
+                        frame_accum[p] /= static_cast<float>(std::max(accum_frames, 1));
                     }
                     p_file.write(reinterpret_cast<char*>(frame_accum.data()),
                                  std::streamsize(frSize * sizeof(float)));
                     std::fill(frame_accum.begin(), frame_accum.end(), 0.0);
+                    accum_frames = 0;
                 }
-                for (size_t p = 0; p < frSize; p++) {
-                    frame_accum[p] += p_frame[p];
+                if (intact) {
+                    for (size_t p = 0; p < frSize; p++) {
+                        frame_accum[p] += p_frame[p];
+                    }
+                    accum_frames++;
                 }
             }
 
@@ -354,6 +431,7 @@ void FrameWorker::saveFrames(save_req_t req)
         }
     }
     p_file.close();
+    leaveRing();
 
     if (req.bit_org == fwBSQ) {
         convertBSQ(req);
@@ -372,6 +450,7 @@ void FrameWorker::saveFrames(save_req_t req)
     hdr_out << hdr_text;
     hdr_out.close();
     qDebug() << "Done saving frames!";
+    pinTo(pool_cpus, nullptr);
     emit doneSaving();
 }
 
@@ -396,16 +475,81 @@ void FrameWorker::collectMask()
         int retval = QMessageBox::warning(nullptr, "Confirm Mask Save",
                              QString("The file: %1 already exists. Are you sure you want to overwrite it?").arg(mask_file),
                              QMessageBox::Ok, QMessageBox::Cancel);
-        if (retval == QMessageBox::Accepted) {
-            DSFilter->start_mask_collection(avgd_frames);
-        } else {
+        if (retval != QMessageBox::Accepted) {
             return;
         }
-    } else {
-        DSFilter->start_mask_collection(avgd_frames);
+    }
+    // A collector still finishing off the last mask is about to notice that it is done.
+    mask_loop.waitForFinished();
+    DSFilter->start_mask_collection(avgd_frames, mask_lossless);
+    if (mask_lossless) {
+        mask_collecting.store(true);
+        mask_loop = QtConcurrent::run(this, &FrameWorker::collectMaskFrames, int64_t(count.load()));
     }
 }
 
+void FrameWorker::collectMaskFrames(int64_t first_frame)
+{
+    std::vector<int> pool_cpus = pinTo(processing_cpus, "mask collection");
+    // Like a recording, the collector keeps the ring from being resized under it.
+    waitRing();
+    const int64_t depth = int64_t(lvframe_buffer->size());
+    std::vector<const uint16_t*> batch;
+    std::vector<LVFrame*> sources;
+    std::vector<uint32_t> versions;
+    int64_t next_frame = first_frame;
+    uint64_t lost = 0;
+
+    while (isRunning && DSFilter->collecting()) {
+        const uint64_t seen = lvframe_buffer->arrivalCount();
+        const int64_t newest = count.load();
+        if (newest - next_frame >= depth) {
+            // The ring has come back around onto these already, carry on from the oldest left.
+            lost += uint64_t(newest - depth + 1 - next_frame);
+            next_frame = newest - depth + 1;
+        }
+        // Everything that came in since the last batch, as far as the mask still wants it.
+        uint64_t n = uint64_t(newest - next_frame);
+        n = std::min(n, uint64_t(MASK_BATCH_FRAMES));
+        n = std::min(n, uint64_t(DSFilter->frames_wanted()));
+        if (n == 0) {
+            lvframe_buffer->waitForFrame(seen, milliseconds(LOOP_IDLE_TIMEOUT_MS));
+            continue;
+        }
+        batch.clear();
+        sources.clear();
+        versions.clear();
+        for (uint64_t f = 0; f < n; f++) {
+            LVFrame *source = lvframe_buffer->frame(uint16_t((next_frame + int64_t(f)) % depth));
+            versions.push_back(source->readBegin());
+            sources.push_back(source);
+            batch.push_back(source->raw_data);
+        }
+        const int64_t first_seq = next_frame + 1;
+        const bool added = DSFilter->collect_frames(batch.data(), n, [&]() {
+            // A frame the ring came back around onto spoils the whole batch.
+            for (size_t f = 0; f < sources.size(); f++) {
+                if (sources[f]->seq.load(std::memory_order_acquire) != uint64_t(first_seq) + f ||
+                        !sources[f]->readValid(versions[f])) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (!added && DSFilter->collecting()) {
+            lost += n;
+        }
+        next_frame += int64_t(n);
+    }
+    leaveRing();
+    mask_collecting.store(false);
+    if (lost > 0) {
+        qWarning("Mask collection fell more than a ring behind, %llu frames are missing from the mask.",
+                 static_cast<unsigned long long>(lost));
+    }
+    pinTo(pool_cpus, nullptr);
+}
+
 void FrameWorker::stopCollectingMask()
 {
     DSFilter->finish_mask_collection();
@@ -414,10 +558,11 @@ void FrameWorker::stopCollectingMask()
     }
 }
 
-void FrameWorker::setMaskSettings(QString mask_name, quint64 avg_frames)
+void FrameWorker::setMaskSettings(QString mask_name, quint64 avg_frames, bool lossless)
 {
     mask_file = std::move(mask_name);
     avgd_frames = avg_frames;
+    mask_lossless = lossless;
 }
 
 void FrameWorker::setStdDevN(int new_N)
@@ -436,6 +581,12 @@ void FrameWorker::reportFPS()
         isTimeout = false;
         fps = double(MAXSAMPLES) * 1000000.0 / double(ticksum);
         emit updateFPS(fps);
+        // Follow the frame rate, but not every wobble of it.
+        const int depth = ringDepthFor(fps);
+        const int current = ring_target.load();
+        if (depth > current + current / 4 || depth < current - current / 4) {
+            ring_target.store(depth);
+        }
     }
 }
 
@@ -443,6 +594,7 @@ void FrameWorker::resetDir(const char *dirname)
 {
     if (cam_type == SSD_XIO || cam_type == SSD_ENVI) {
         Camera->setDir(dirname);
+        pacer.reset();
     }
 }
 
@@ -450,35 +602,68 @@ std::vector<float> FrameWorker::getFrame()
 {
     //Maintains reference to data by using vector for memory management
 
-    uint16_t last_ndx = lvframe_buffer->dsfIndex.load();
-    // int prev_ndx = (lvframe_buffer->lastIndex.load() - 1) % 200;
     std::vector<float> raw_data(frSize);
-    // if (lvframe_buffer->frame(last_ndx)->raw_data[1000] > 35000) {
-    //     qDebug() << lvframe_buffer->fbIndex << lvframe_buffer->lastSTD()->raw_data[1000] << last_ndx << lvframe_buffer->frame(last_ndx)->raw_data[1000];
-    // }
-    for (unsigned int i = 0; i < frSize; i++) {
-        raw_data[i] = float(lvframe_buffer->frame(last_ndx)->raw_data[i]);
+    // The GUI does not wait for a resize to get the ring back, it draws the last frame again.
+    if (!enterRing()) {
+        return last_raw.empty() ? raw_data : last_raw;
     }
+    for (int attempt = 0; attempt < READ_RETRIES; attempt++) {
+        LVFrame *last = lvframe_buffer->lastDSF();
+        const uint32_t version = last->readBegin();
+        const uint64_t seq = last->seq.load(std::memory_order_relaxed);
+        const uint16_t *pixels = last->raw_data;
+        if (!last->readValid(version)) {
+            continue;
+        }
+        // The raw frame the DSF loop worked on may since have been overwritten as well.
+        LVFrame *raw = seq ? lvframe_buffer->slotOf(seq) : nullptr;
+        const uint32_t raw_version = raw ? raw->readBegin() : 0;
+        for (unsigned int i = 0; i < frSize; i++) {
+            raw_data[i] = float(pixels[i]);
+        }
+        if (!raw || (raw->readValid(raw_version) && raw->seq.load(std::memory_order_relaxed) == seq)) {
+            countDisplayed(seq);
+            break;
+        }
+    }
+    leaveRing();
+    last_raw = raw_data;
     return raw_data;
 }
 
 std::vector<float> FrameWorker::getDSFrame()
 {
-    //Maintains reference to data by using vector for memory management
-    return std::vector<float>(lvframe_buffer->lastDSF()->dsf_data, lvframe_buffer->lastDSF()->dsf_data + frSize);
+    return readProduct(true, &LVFrame::dsf_data);
 }
 
 std::vector<float> FrameWorker::getSDFrame()
 {
-    //Maintains reference to data by using vector for memory management
-
-    return std::vector<float>(lvframe_buffer->lastSTD()->sdv_data, lvframe_buffer->lastSTD()->sdv_data + frSize);
+    return readProduct(false, &LVFrame::sdv_data);
 }
 
 std::vector<float> FrameWorker::getSNRFrame()
+{
+    return readProduct(false, &LVFrame::snr_data);
+}
+
+std::vector<float> FrameWorker::readProduct(bool dsf, float *LVFrame::*plane)
 {
     //Maintains reference to data by using vector for memory management
-    return std::vector<float>(lvframe_buffer->lastSTD()->snr_data, lvframe_buffer->lastSTD()->snr_data + frSize);
+    std::vector<float> data(frSize);
+    // A failed read means the loop came back around onto the slot, so it has published since.
+    for (int attempt = 0; attempt < READ_RETRIES; attempt++) {
+        LVFrame *product = dsf ? lvframe_buffer->lastDSF() : lvframe_buffer->lastSTD();
+        const uint32_t version = product->readBegin();
+        const uint64_t seq = product->seq.load(std::memory_order_relaxed);
+        std::copy(product->*plane, product->*plane + frSize, data.begin());
+        if (product->readValid(version)) {
+            if (dsf) {
+                countDisplayed(seq);
+            }
+            break;
+        }
+    }
+    return data;
 }
 
 uint32_t* FrameWorker::getHistData()
@@ -501,6 +686,30 @@ float* FrameWorker::getFrameFFT()
     return lvframe_buffer->lastDSF()->frame_fft;
 }
 
+void FrameWorker::writeMeta(std::ofstream &out, uint64_t line, const LVFrameMeta &meta)
+{
+    out << line << ',' << meta.seq << ',' << meta.mono_ns << ',' << meta.host_ns << ','
+        << meta.source_ns << ',' << meta.source_frame << ',' << meta.status << ',';
+    for (int w = 0; w < meta.header_words; w++) {
+        out << (w ? " " : "") << meta.header[w];
+    }
+    out << '\n';
+}
+
+LVFrameMeta FrameWorker::getFrameMeta()
+{
+    LVFrameMeta meta;
+    for (int attempt = 0; attempt < READ_RETRIES; attempt++) {
+        LVFrame *last = lvframe_buffer->lastDSF();
+        const uint32_t version = last->readBegin();
+        meta = last->meta;
+        if (last->readValid(version)) {
+            break;
+        }
+    }
+    return meta;
+}
+
 std::vector<uint16_t> FrameWorker::getBILSaveFrame()
 {
     std::vector<uint16_t> BIL_frame;
@@ -582,14 +791,6 @@ void FrameWorker::convertBSQ(save_req_t req)
     }
 }
 
-void FrameWorker::delay(int64_t msecs)
-{
-    QTime remTime = QTime::currentTime().addMSecs(int(msecs));
-    while(QTime::currentTime() < remTime) {
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-    }
-}
-
 void FrameWorker::setCenter(double Xcoord, double Ycoord)
 {
     centerVal.setX(Xcoord);
@@ -620,6 +821,208 @@ void FrameWorker::compute_snr(LVFrame *new_frame)
 
 void FrameWorker::setFramePeriod(double period) {
     frame_period_ms = period;
+    pacer.setPeriod(period);
+}
+
+void FrameWorker::setPacingMode(int mode) {
+    pacer.setMode(pace_mode_t(mode));
+}
+
+pace_mode_t FrameWorker::getPacingMode() {
+    return pacer.getMode();
+}
+
+stage_stats_t FrameWorker::getStageStats(stage_t stage)
+{
+    stage_stats_t stats;
+    stats.processed = stage_processed[stage].load();
+    stats.skipped = stage_skipped[stage].load();
+    // Dark subtraction and standard deviation are counted by their stages.
+    if (stage_graph && (stage == STAGE_DSF || stage == STAGE_STD)) {
+        stats = stage_graph->stats(stage == STAGE_DSF ? "dark_subtract" : "stddev");
+    }
+    if (stage == STAGE_INGEST) {
+        stats.skipped += Camera->droppedFrames();
+    }
+    return stats;
+}
+
+void FrameWorker::setRingBudget(int budget_mb, int slack_ms)
+{
+    ring_budget_mb.store(std::max(budget_mb, 1));
+    ring_slack_ms.store(std::max(slack_ms, 1));
+    ring_target.store(ringDepthFor(fps));
+}
+
+size_t FrameWorker::getRingDepth()
+{
+    return lvframe_buffer->size();
+}
+
+size_t FrameWorker::getRingBytes()
+{
+    return lvframe_buffer->arenaBytes();
+}
+
+int FrameWorker::ringDepthFor(double frame_rate)
+{
+    const size_t frame_bytes = frSize * sizeof(uint16_t);
+    const size_t budget_frames = size_t(ring_budget_mb.load()) * 1024 * 1024 / std::max<size_t>(frame_bytes, 1);
+    // Until the frame rate is known, keep the depth LiveView always had.
+    size_t depth = frame_rate > 0 ? size_t(std::ceil(frame_rate * ring_slack_ms.load() / 1000.0))
+                                  : CPU_FRAME_BUFFER_SIZE;
+    depth = std::min(depth, budget_frames);
+    depth = std::max(depth, size_t(RING_MIN_FRAMES));
+    return int(std::min(depth, size_t(RING_MAX_FRAMES)));
+}
+
+std::vector<int> FrameWorker::pinTo(const std::vector<int> &cpus, const char *role)
+{
+    std::vector<int> previous;
+    if (cpus.empty()) {
+        return previous;
+    }
+    if (!os::pinThread(cpus, &previous)) {
+        if (role) {
+            qWarning("Unable to pin the %s thread to the CPUs configured for it.", role);
+        }
+    } else if (role) {
+        qDebug() << "Pinned the" << role << "thread to" << cpus.size() << "CPUs starting at" << cpus.front();
+    }
+    return previous;
+}
+
+bool FrameWorker::enterRing()
+{
+    ring_users++;
+    if (ring_hold.load()) {
+        ring_users--;
+        return false;
+    }
+    return true;
+}
+
+void FrameWorker::waitRing()
+{
+    while (!enterRing()) {
+        std::unique_lock<std::mutex> lock(ring_lock);
+        ring_free.wait_for(lock, milliseconds(LOOP_IDLE_TIMEOUT_MS), [this]() { return !ring_hold.load(); });
+    }
+}
+
+void FrameWorker::releaseRing()
+{
+    {
+        std::lock_guard<std::mutex> lock(ring_lock);
+        ring_hold.store(false);
+    }
+    ring_free.notify_all();
+}
+
+void FrameWorker::leaveRing()
+{
+    ring_users--;
+}
+
+void FrameWorker::resizeRing()
+{
+    const int depth = ring_target.load();
+    // A recording or a mask keeps the ring busy until it is done.
+    if (saving || mask_collecting.load() || depth == int(lvframe_buffer->size())) {
+        releaseRing();
+        return;
+    }
+    // Mapping and locking the new arena takes long enough to lose frames, so it is done on a
+    // job of its own while frames keep going into the old ring.
+    if (lvframe_buffer->preparedDepth() != depth) {
+        if (!ring_prep.isRunning()) {
+            ring_prep = QtConcurrent::run(lvframe_buffer, &LVFrameBuffer::prepareDepth, depth);
+        }
+        return;
+    }
+    // Keep new readers out, and swap at the first frame boundary nobody is reading at.
+    ring_hold.store(true);
+    if (ring_users.load() > 0) {
+        return;
+    }
+    const size_t old_depth = lvframe_buffer->size();
+    if (lvframe_buffer->adoptDepth()) {
+        // Frames are found in the ring by their count, so writing carries on where that says.
+        const int index = int(count.load() % depth);
+        lvframe_buffer->fbIndex.store(index);
+        lvframe_buffer->lastIndex.store(index);
+        qDebug() << "Frame ring resized from" << old_depth << "to" << depth << "frames,"
+                 << (lvframe_buffer->arenaBytes() >> 20) << "MB";
+        ring_prep.waitForFinished();
+        ring_prep = QtConcurrent::run(lvframe_buffer, &LVFrameBuffer::releaseRetired);
+    }
+    releaseRing();
+}
+
+void FrameWorker::resetStageStats()
+{
+    for (int s = 0; s < NUM_STAGES; s++) {
+        stage_processed[s].store(0);
+        stage_skipped[s].store(0);
+    }
+    if (stage_graph) {
+        stage_graph->resetStats();
+    }
+}
+
+void FrameWorker::countDisplayed(uint64_t seq)
+{
+    // Several widgets draw from the same frame, only the first one to get to it counts it.
+    uint64_t last = display_seq.load();
+    while (seq > last) {
+        if (display_seq.compare_exchange_weak(last, seq)) {
+            stage_processed[STAGE_DISPLAY]++;
+            if (last > 0) {
+                stage_skipped[STAGE_DISPLAY] += seq - last - 1;
+            }
+            break;
+        }
+    }
+}
+
+void FrameWorker::setPlayback(int dir) {
+    if (dir == 0) {
+        paused.store(true);
+        return;
+    }
+    Camera->setPlayDirection(dir);
+    steps_pending.store(0);
+    paused.store(false);
+    pacer.reset();
+}
+
+void FrameWorker::stepFrames(int delta) {
+    if (delta == 0 || !Camera->isSeekable()) {
+        return;
+    }
+    paused.store(true);
+    const int dir = delta > 0 ? 1 : -1;
+    if (dir != Camera->playDirection()) {
+        Camera->setPlayDirection(dir);
+    }
+    if (std::abs(delta) > 1 && Camera->currentFrame() >= 0) {
+        Camera->seek(Camera->currentFrame() + delta);
+    }
+    steps_pending.store(1);
+}
+
+void FrameWorker::seekFrame(qint64 frame) {
+    if (!Camera->isSeekable() || !Camera->seek(frame)) {
+        return;
+    }
+    pacer.reset();
+    if (paused.load()) {
+        steps_pending.store(1); // show the frame we landed on
+    }
+}
+
+void FrameWorker::setLoopRange(qint64 first, qint64 last) {
+    Camera->setLoop(first, last);
 }
 
 double FrameWorker::getFramePeriod() {
@@ -0,0 +1,206 @@
+#include "ingestfilter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Flipping the sign bit of 14 or 16 bit twos-complement data makes it offset binary.
+static const uint16_t REMAP_14 = 0x2000;
+static const uint16_t REMAP_16 = 0x8000;
+
+#ifdef __SSE2__
+static inline __m128i load128(const uint16_t *src)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+}
+
+static inline void store128(uint16_t *dst, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+}
+
+template <uint16_t Mask>
+static inline __m128i remap128(__m128i v)
+{
+    return Mask ? _mm_xor_si128(v, _mm_set1_epi16(short(Mask))) : v;
+}
+
+/* Splits 8 * Taps interleaved pixels into Taps vectors of 8, one per tap. Each round of
+ * unpacks halves the interleave, so it takes log2(Taps) of them, plus one for 8 taps. */
+template <int Taps> struct deinterleave;
+
+template <> struct deinterleave<2>
+{
+    static inline void run(const uint16_t *in, __m128i out[2])
+    {
+        __m128i a = load128(in), b = load128(in + 8);
+        __m128i lo = _mm_unpacklo_epi16(a, b), hi = _mm_unpackhi_epi16(a, b);
+        a = _mm_unpacklo_epi16(lo, hi);
+        b = _mm_unpackhi_epi16(lo, hi);
+        out[0] = _mm_unpacklo_epi16(a, b);
+        out[1] = _mm_unpackhi_epi16(a, b);
+    }
+};
+
+template <> struct deinterleave<4>
+{
+    static inline void run(const uint16_t *in, __m128i out[4])
+    {
+        __m128i a = load128(in), b = load128(in + 8), c = load128(in + 16), d = load128(in + 24);
+        __m128i ab_lo = _mm_unpacklo_epi16(a, b), ab_hi = _mm_unpackhi_epi16(a, b);
+        __m128i cd_lo = _mm_unpacklo_epi16(c, d), cd_hi = _mm_unpackhi_epi16(c, d);
+        // Taps 0 and 1, then taps 2 and 3 of four pixels each
+        a = _mm_unpacklo_epi16(ab_lo, ab_hi);
+        b = _mm_unpackhi_epi16(ab_lo, ab_hi);
+        c = _mm_unpacklo_epi16(cd_lo, cd_hi);
+        d = _mm_unpackhi_epi16(cd_lo, cd_hi);
+        out[0] = _mm_unpacklo_epi64(a, c);
+        out[1] = _mm_unpackhi_epi64(a, c);
+        out[2] = _mm_unpacklo_epi64(b, d);
+        out[3] = _mm_unpackhi_epi64(b, d);
+    }
+};
+
+// With 8 taps, this is a transpose of 8 x 8 pixels.
+template <> struct deinterleave<8>
+{
+    static inline void run(const uint16_t *in, __m128i out[8])
+    {
+        __m128i v[8], w[8];
+        for (int i = 0; i < 8; i++) {
+            v[i] = load128(in + 8 * i);
+        }
+        for (int i = 0; i < 4; i++) {
+            w[2 * i] = _mm_unpacklo_epi16(v[2 * i], v[2 * i + 1]);
+            w[2 * i + 1] = _mm_unpackhi_epi16(v[2 * i], v[2 * i + 1]);
+        }
+        for (int i = 0; i < 2; i++) {
+            v[4 * i] = _mm_unpacklo_epi32(w[4 * i], w[4 * i + 2]);
+            v[4 * i + 1] = _mm_unpackhi_epi32(w[4 * i], w[4 * i + 2]);
+            v[4 * i + 2] = _mm_unpacklo_epi32(w[4 * i + 1], w[4 * i + 3]);
+            v[4 * i + 3] = _mm_unpackhi_epi32(w[4 * i + 1], w[4 * i + 3]);
+        }
+        for (int i = 0; i < 4; i++) {
+            out[2 * i] = _mm_unpacklo_epi64(v[i], v[i + 4]);
+            out[2 * i + 1] = _mm_unpackhi_epi64(v[i], v[i + 4]);
+        }
+    }
+};
+#endif
+
+// Copies n pixels, remapping them on the way. In place is fine.
+template <uint16_t Mask>
+static inline void remap_copy(const uint16_t *src, uint16_t *dst, size_t n)
+{
+    if (!Mask) {
+        if (src != dst) {
+            memcpy(dst, src, n * sizeof(uint16_t));
+        }
+        return;
+    }
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+        store128(dst + i, remap128<Mask>(load128(src + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = src[i] ^ Mask;
+    }
+}
+
+template <uint16_t Mask>
+static void ingest_straight(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols,
+                            size_t data_rows, uint16_t *scratch)
+{
+    (void)rows;
+    (void)scratch;
+    remap_copy<Mask>(src, dst, data_rows * cols);
+}
+
+template <uint16_t Mask, int Taps>
+static void ingest_deinterlaced(const uint16_t *src, uint16_t *dst, size_t rows, size_t cols,
+                                size_t data_rows, uint16_t *scratch)
+{
+    const size_t tap_width = cols / Taps;
+    for (size_t r = 0; r < rows; r++) {
+        const uint16_t *in = src + r * cols;
+        uint16_t *out = dst + r * cols;
+        if (in == out) {
+            // One row fits in L1, so this costs no extra trip to memory.
+            memcpy(scratch, in, cols * sizeof(uint16_t));
+            in = scratch;
+        }
+        size_t x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= tap_width; x += 8) {
+            __m128i taps[Taps];
+            deinterleave<Taps>::run(in + Taps * x, taps);
+            for (int t = 0; t < Taps; t++) {
+                store128(out + t * tap_width + x, remap128<Mask>(taps[t]));
+            }
+        }
+#endif
+        for (; x < tap_width; x++) {
+            for (int t = 0; t < Taps; t++) {
+                out[t * tap_width + x] = in[Taps * x + t] ^ Mask;
+            }
+        }
+        // Columns past the last whole group of taps stay where they are.
+        remap_copy<Mask>(in + tap_width * Taps, out + tap_width * Taps, cols - tap_width * Taps);
+    }
+    remap_copy<Mask>(src + rows * cols, dst + rows * cols, (data_rows - rows) * cols);
+}
+
+IngestFilter::IngestFilter(size_t num_rows, size_t num_cols, size_t data_rows, int taps) :
+    nRows(num_rows), nCols(num_cols), dataRows(std::max(data_rows, num_rows)), nTaps(taps),
+    row_scratch(num_cols)
+{
+    switch (taps) {
+    case 2: selectKernels<2>(); break;
+    case 8: selectKernels<8>(); break;
+    default:
+        if (taps != 4) {
+            qWarning("Deinterlacing over %d taps is not supported, using 4.", taps);
+            nTaps = 4;
+        }
+        selectKernels<4>();
+        break;
+    }
+}
+
+template <int Taps>
+void IngestFilter::selectKernels()
+{
+    kernels[0][0] = &ingest_straight<0>;
+    kernels[1][0] = &ingest_straight<REMAP_14>;
+    kernels[2][0] = &ingest_straight<REMAP_16>;
+    kernels[0][1] = &ingest_deinterlaced<0, Taps>;
+    kernels[1][1] = &ingest_deinterlaced<REMAP_14, Taps>;
+    kernels[2][1] = &ingest_deinterlaced<REMAP_16, Taps>;
+}
+
+void IngestFilter::apply_filter_scalar(const uint16_t *src, uint16_t *dst, bool remap, bool is16bit, bool interlace)
+{
+    const uint16_t mask = remap ? (is16bit ? REMAP_16 : REMAP_14) : 0;
+    const size_t taps = interlace ? size_t(nTaps) : 1;
+    const size_t tap_width = nCols / taps;
+    for (size_t r = 0; r < dataRows; r++) {
+        const uint16_t *in = src + r * nCols;
+        uint16_t *out = dst + r * nCols;
+        if (in == out) {
+            memcpy(row_scratch.data(), in, nCols * sizeof(uint16_t));
+            in = row_scratch.data();
+        }
+        for (size_t c = 0; c < nCols; c++) {
+            size_t from = c;
+            if (r < nRows && c < tap_width * taps) {
+                from = taps * (c % tap_width) + c / tap_width;
+            }
+            out[c] = in[from] ^ mask;
+        }
+    }
+}
@@ -0,0 +1,417 @@
+#include "lvframebuffer.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <QtGlobal>
+#include <QDebug>
+
+#include "osutils.h"
+
+static const size_t CACHE_LINE = 64;
+static const size_t PAGE_BYTES = 4096;
+static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+enum plane_t {P_RAW, P_DSF, P_SDV, P_SNR, P_HIST, P_SPECTRAL, P_SPATIAL, P_FFT};
+
+struct plane_run_t
+{
+    plane_t plane;
+    int count;     // planes in the run
+    size_t offset; // of the run from the start of the arena
+    size_t stride; // from one frame's plane to the next
+};
+
+static size_t roundUp(size_t n, size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+static size_t planeStride(size_t bytes)
+{
+    size_t stride = roundUp(bytes, CACHE_LINE);
+    // With a stride of whole pages the start of every frame would land in the same cache sets.
+    if (stride % PAGE_BYTES == 0) {
+        stride += CACHE_LINE;
+    }
+    return stride;
+}
+
+static size_t planeBytes(plane_t plane, int frame_width, int frame_height)
+{
+    const size_t frSize = size_t(frame_width) * size_t(frame_height);
+    switch (plane) {
+    case P_RAW: return frSize * sizeof(uint16_t);
+    case P_DSF:
+    case P_SDV:
+    case P_SNR: return frSize * sizeof(float);
+    case P_HIST: return NUMBER_OF_BINS * sizeof(uint32_t);
+    case P_SPECTRAL: return size_t(frame_height) * sizeof(float);
+    case P_SPATIAL: return size_t(frame_width) * sizeof(float);
+    case P_FFT: return MAX_FFT_SIZE * sizeof(float);
+    }
+    return 0;
+}
+
+// Places the plane runs and returns the size of the arena they need.
+static size_t planLayout(plane_run_t *runs, int num_runs, int frame_width, int frame_height)
+{
+    size_t offset = 0;
+    for (int r = 0; r < num_runs; r++) {
+        runs[r].offset = offset;
+        runs[r].stride = planeStride(planeBytes(runs[r].plane, frame_width, frame_height));
+        offset = roundUp(offset + runs[r].stride * size_t(runs[r].count), PAGE_BYTES);
+    }
+    return offset;
+}
+
+template <typename T>
+static T* planeAt(unsigned char *base, const plane_run_t &run, int f)
+{
+    return reinterpret_cast<T*>(base + run.offset + size_t(f) * run.stride);
+}
+
+LVFrameBuffer::LVFrameBuffer(const int num_frames, const int frame_width, const int frame_height,
+                             const int product_frames, const int node)
+    : lastIndex(0), fbIndex(0),  dsfIndex(-1), stdIndex(-1),
+      width(0), height(0), product_depth(product_frames < 2 ? 2 : product_frames),
+      numa_node(node), spare_width(0), spare_height(0), arrivals(0), waiters(0), blank(nullptr)
+{
+    raw_arena = arena_t{nullptr, 0, false, false};
+    blank_arena = arena_t{nullptr, 0, false, false};
+    spare_arena = arena_t{nullptr, 0, false, false};
+    retired_arena = arena_t{nullptr, 0, false, false};
+    dsf_ring.kind = PRODUCT_DSF;
+    std_ring.kind = PRODUCT_STD;
+    for (product_ring_t *ring : {&dsf_ring, &std_ring}) {
+        ring->arena = arena_t{nullptr, 0, false, false};
+        ring->next = 0;
+        ring->source = nullptr;
+        ring->source_version = 0;
+    }
+    layout(num_frames, frame_width, frame_height);
+}
+
+LVFrameBuffer::~LVFrameBuffer()
+{
+    clearFrames(frame_vec);
+    clearFrames(spare_frames);
+    clearFrames(retired_frames);
+    clearFrames(dsf_ring.frames);
+    clearFrames(std_ring.frames);
+    delete blank;
+    unmapArena(raw_arena);
+    unmapArena(spare_arena);
+    unmapArena(retired_arena);
+    unmapArena(blank_arena);
+    unmapArena(dsf_ring.arena);
+    unmapArena(std_ring.arena);
+    qDebug() << "LVFrameBuffer Destruct";
+}
+
+void LVFrameBuffer::reset(const int num_frames, const int frame_width, const int frame_height)
+{
+    // The published products still point at the raw frames about to go away.
+    dsfIndex.store(-1);
+    stdIndex.store(-1);
+    layout(num_frames, frame_width, frame_height);
+    lastIndex.store(0);
+    fbIndex.store(0, std::memory_order_release);
+}
+
+void LVFrameBuffer::prepareDepth(const int num_frames)
+{
+    int frame_width, frame_height;
+    {
+        std::lock_guard<std::mutex> lock(spare_lock);
+        frame_width = width;
+        frame_height = height;
+    }
+    // Mapped and locked outside the lock, adoptDepth() must not wait on this.
+    plane_run_t raw_run = {P_RAW, num_frames, 0, 0};
+    arena_t arena = arena_t{nullptr, 0, false, false};
+    mapArena(arena, planLayout(&raw_run, 1, frame_width, frame_height), "frame");
+    std::vector<LVFrame*> frames;
+    frames.reserve(size_t(num_frames));
+    for (int f = 0; f < num_frames; ++f) {
+        auto pFrame = new LVFrame(frame_width, frame_height);
+        pFrame->raw_data = planeAt<uint16_t>(arena.base, raw_run, f);
+        frames.push_back(pFrame);
+    }
+
+    std::lock_guard<std::mutex> lock(spare_lock);
+    std::swap(spare_arena, arena);
+    spare_frames.swap(frames);
+    spare_width = frame_width;
+    spare_height = frame_height;
+    // Whatever was prepared before goes, it was for another depth.
+    clearFrames(frames);
+    unmapArena(arena);
+}
+
+int LVFrameBuffer::preparedDepth()
+{
+    std::lock_guard<std::mutex> lock(spare_lock);
+    return spare_width == width && spare_height == height ? int(spare_frames.size()) : 0;
+}
+
+bool LVFrameBuffer::adoptDepth()
+{
+    std::lock_guard<std::mutex> lock(spare_lock);
+    if (spare_frames.empty() || spare_width != width || spare_height != height) {
+        return false;
+    }
+    // The published products still point at the raw frames about to go away.
+    dsfIndex.store(-1);
+    stdIndex.store(-1);
+    // Normally released right after it was retired, unless the ring changed again since.
+    clearFrames(retired_frames);
+    unmapArena(retired_arena);
+    retired_frames.swap(frame_vec);
+    frame_vec.swap(spare_frames);
+    retired_arena = raw_arena;
+    raw_arena = spare_arena;
+    spare_arena = arena_t{nullptr, 0, false, false};
+    lastIndex.store(0);
+    fbIndex.store(0, std::memory_order_release);
+    return true;
+}
+
+void LVFrameBuffer::releaseRetired()
+{
+    std::vector<LVFrame*> frames;
+    arena_t arena;
+    {
+        std::lock_guard<std::mutex> lock(spare_lock);
+        frames.swap(retired_frames);
+        arena = retired_arena;
+        retired_arena = arena_t{nullptr, 0, false, false};
+    }
+    clearFrames(frames);
+    unmapArena(arena);
+}
+
+void LVFrameBuffer::layout(const int num_frames, const int frame_width, const int frame_height)
+{
+    plane_run_t raw_run = {P_RAW, num_frames, 0, 0};
+    const size_t bytes = planLayout(&raw_run, 1, frame_width, frame_height);
+    // Also give memory back when the ring gets much shallower.
+    if (bytes > raw_arena.size || bytes < raw_arena.size / 2) {
+        unmapArena(raw_arena);
+        mapArena(raw_arena, bytes, "frame");
+    }
+    clearFrames(frame_vec);
+    frame_vec.reserve(size_t(num_frames));
+    for (int f = 0; f < num_frames; ++f) {
+        auto pFrame = new LVFrame(frame_width, frame_height);
+        pFrame->raw_data = planeAt<uint16_t>(raw_arena.base, raw_run, f);
+        frame_vec.push_back(pFrame);
+    }
+
+    if (blank && frame_width == width && frame_height == height) {
+        // Only the depth changed, the products and the blank frame stay where they are.
+        return;
+    }
+    std::lock_guard<std::mutex> lock(spare_lock);
+    width = frame_width;
+    height = frame_height;
+
+    plane_run_t runs[] = {
+        {P_SNR, 1, 0, 0},
+        {P_HIST, 1, 0, 0},
+        {P_SPECTRAL, 1, 0, 0},
+        {P_SPATIAL, 1, 0, 0},
+        {P_FFT, 1, 0, 0}
+    };
+    const int num_runs = int(sizeof(runs) / sizeof(runs[0]));
+    unmapArena(blank_arena);
+    mapArena(blank_arena, planLayout(runs, num_runs, frame_width, frame_height), "blank frame");
+    delete blank;
+    blank = new LVFrame(frame_width, frame_height);
+    float *zeros = planeAt<float>(blank_arena.base, runs[0], 0);
+    blank->raw_data = reinterpret_cast<uint16_t*>(zeros);
+    blank->dsf_data = zeros;
+    blank->sdv_data = zeros;
+    blank->snr_data = zeros;
+    blank->hist_data = planeAt<uint32_t>(blank_arena.base, runs[1], 0);
+    blank->spectral_mean = planeAt<float>(blank_arena.base, runs[2], 0);
+    blank->spatial_mean = planeAt<float>(blank_arena.base, runs[3], 0);
+    blank->frame_fft = planeAt<float>(blank_arena.base, runs[4], 0);
+
+    // The product rings are laid out again when they are next bound.
+    for (product_ring_t *ring : {&dsf_ring, &std_ring}) {
+        clearFrames(ring->frames);
+        ring->next = 0;
+        ring->source = nullptr;
+    }
+}
+
+void LVFrameBuffer::layoutProducts(product_ring_t &ring)
+{
+    static const plane_t dsf_planes[] = {P_DSF, P_SPECTRAL, P_SPATIAL, P_FFT};
+    static const plane_t std_planes[] = {P_SDV, P_SNR, P_HIST};
+    const plane_t *planes = ring.kind == PRODUCT_DSF ? dsf_planes : std_planes;
+    const int num_runs = ring.kind == PRODUCT_DSF ? 4 : 3;
+    plane_run_t runs[4];
+    for (int r = 0; r < num_runs; r++) {
+        runs[r] = plane_run_t{planes[r], product_depth, 0, 0};
+    }
+    const size_t bytes = planLayout(runs, num_runs, width, height);
+    if (bytes > ring.arena.size) {
+        unmapArena(ring.arena);
+        mapArena(ring.arena, bytes, ring.kind == PRODUCT_DSF ? "DSF" : "standard deviation");
+    }
+
+    ring.frames.reserve(size_t(product_depth));
+    for (int f = 0; f < product_depth; ++f) {
+        auto pFrame = new LVFrame(width, height);
+        if (ring.kind == PRODUCT_DSF) {
+            pFrame->dsf_data = planeAt<float>(ring.arena.base, runs[0], f);
+            pFrame->spectral_mean = planeAt<float>(ring.arena.base, runs[1], f);
+            pFrame->spatial_mean = planeAt<float>(ring.arena.base, runs[2], f);
+            pFrame->frame_fft = planeAt<float>(ring.arena.base, runs[3], f);
+        } else {
+            pFrame->sdv_data = planeAt<float>(ring.arena.base, runs[0], f);
+            pFrame->snr_data = planeAt<float>(ring.arena.base, runs[1], f);
+            pFrame->hist_data = planeAt<uint32_t>(ring.arena.base, runs[2], f);
+        }
+        ring.frames.push_back(pFrame);
+    }
+    ring.next = 0;
+}
+
+LVFrame* LVFrameBuffer::bindDSF(uint16_t raw_index)
+{
+    return bind(dsf_ring, raw_index);
+}
+
+LVFrame* LVFrameBuffer::bindSTD(uint16_t raw_index)
+{
+    return bind(std_ring, raw_index);
+}
+
+LVFrame* LVFrameBuffer::bind(product_ring_t &ring, uint16_t raw_index)
+{
+    if (ring.frames.empty()) {
+        layoutProducts(ring);
+    }
+    LVFrame *src = frame(raw_index);
+    LVFrame *slot = ring.frames[size_t(ring.next)];
+    if (!(slot->version.load(std::memory_order_relaxed) & 1)) {
+        // Otherwise it was bound before and never published, and is still open for writing.
+        slot->beginWrite();
+    }
+    ring.source = src;
+    ring.source_version = src->readBegin();
+    slot->raw_data = src->raw_data;
+    slot->meta = src->meta;
+    slot->seq.store(src->seq.load(std::memory_order_acquire), std::memory_order_relaxed);
+    if (ring.kind == PRODUCT_DSF) {
+        LVFrame *std_frame = lastSTD();
+        slot->sdv_data = std_frame->sdv_data;
+        slot->snr_data = std_frame->snr_data;
+        slot->hist_data = std_frame->hist_data;
+    } else {
+        LVFrame *dsf_frame = lastDSF();
+        slot->dsf_data = dsf_frame->dsf_data;
+        slot->spectral_mean = dsf_frame->spectral_mean;
+        slot->spatial_mean = dsf_frame->spatial_mean;
+        slot->frame_fft = dsf_frame->frame_fft;
+    }
+    return slot;
+}
+
+LVFrame* LVFrameBuffer::published(product_ring_t &ring, std::atomic<int> &index)
+{
+    const int i = index.load(std::memory_order_acquire);
+    return i < 0 ? blank : ring.frames.at(size_t(i));
+}
+
+bool LVFrameBuffer::publish(product_ring_t &ring, std::atomic<int> &index)
+{
+    if (ring.frames.empty()) {
+        return false;
+    }
+    // Whatever was derived from a raw frame that got overwritten underneath is not published.
+    const bool intact = ring.source->readValid(ring.source_version);
+    ring.frames[size_t(ring.next)]->endWrite();
+    if (intact) {
+        index.store(ring.next, std::memory_order_release);
+        ring.next = (ring.next + 1) % int(ring.frames.size());
+    }
+    return intact;
+}
+
+void LVFrameBuffer::mapArena(arena_t &arena, size_t bytes, const char *what)
+{
+    const size_t len = roundUp(bytes, HUGE_PAGE_BYTES);
+    void *map = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Only succeeds if the administrator reserved huge pages (vm.nr_hugepages).
+    map = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    arena.huge_pages = map != MAP_FAILED;
+    if (!arena.huge_pages) {
+        // Map with room to spare and trim to a 2 MB boundary, so that transparent huge pages can back it.
+        void *raw = mmap(nullptr, len + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            qFatal("Not enough memory to allocate the %s ring.", what);
+        }
+        const size_t head = roundUp(uintptr_t(raw), HUGE_PAGE_BYTES) - uintptr_t(raw);
+        if (head) {
+            munmap(raw, head);
+        }
+        if (HUGE_PAGE_BYTES - head) {
+            munmap(static_cast<unsigned char*>(raw) + head + len, HUGE_PAGE_BYTES - head);
+        }
+        map = static_cast<unsigned char*>(raw) + head;
+#ifdef MADV_HUGEPAGE
+        madvise(map, len, MADV_HUGEPAGE);
+#endif
+    }
+    arena.base = static_cast<unsigned char*>(map);
+    arena.size = len;
+    // Has to happen before mlock() faults the pages in.
+    if (numa_node >= 0 && !os::bindToNode(arena.base, arena.size, numa_node)) {
+        qWarning("Unable to place the %s ring on NUMA node %d: %s", what, numa_node, strerror(errno));
+    }
+
+    rlimit cur_lims;
+    if (getrlimit(RLIMIT_MEMLOCK, &cur_lims) == 0 && cur_lims.rlim_cur != RLIM_INFINITY) {
+        rlimit new_limit = { RLIM_INFINITY, RLIM_INFINITY };
+        if (setrlimit(RLIMIT_MEMLOCK, &new_limit) == -1) {
+            // Unprivileged, go as far as the hard limit allows.
+            new_limit.rlim_cur = cur_lims.rlim_max;
+            new_limit.rlim_max = cur_lims.rlim_max;
+            setrlimit(RLIMIT_MEMLOCK, &new_limit);
+        }
+    }
+    arena.locked = mlock(arena.base, arena.size) == 0;
+    if (!arena.locked) {
+        qWarning("Unable to lock the %zu MB %s ring into memory: %s", arena.size >> 20, what, strerror(errno));
+    }
+    qDebug() << "Arena for the" << what << "ring of" << (arena.size >> 20) << "MB"
+             << (arena.huge_pages ? "on huge pages" : "on regular pages") << (arena.locked ? "locked" : "not locked");
+}
+
+void LVFrameBuffer::unmapArena(arena_t &arena)
+{
+    if (!arena.base) {
+        return;
+    }
+    if (arena.locked) {
+        munlock(arena.base, arena.size);
+    }
+    munmap(arena.base, arena.size);
+    arena = arena_t{nullptr, 0, false, false};
+}
+
+void LVFrameBuffer::clearFrames(std::vector<LVFrame*> &frames)
+{
+    for (auto &elem : frames) {
+        delete elem;
+        elem = nullptr;
+    }
+    frames.clear();
+}
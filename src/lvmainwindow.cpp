@@ -1,9 +1,11 @@
 #include "lvmainwindow.h"
 #include <QFileInfo>
 #include <QDir>
+#include <QInputDialog>
+#include <climits>
 
-LVMainWindow::LVMainWindow(QSettings *settings, QWidget *parent)
-    : QMainWindow(parent), settings(settings)
+LVMainWindow::LVMainWindow(QSettings *settings, WorkStealingPool *stage_pool, int source_index, QWidget *parent)
+    : QMainWindow(parent), settings(settings), source_index(source_index)
 {   
     notInitialized = true;
     setAcceptDrops(true);
@@ -13,13 +15,22 @@ LVMainWindow::LVMainWindow(QSettings *settings, QWidget *parent)
 
     QPixmap icon_pixmap(":images/icon.png");
     this->setWindowIcon(QIcon(icon_pixmap));
-    this->setWindowTitle("LiveView 4.0");
+    if (source_index == 0) {
+        this->setWindowTitle("LiveView 4.0");
+    } else {
+        this->setWindowTitle(QString("LiveView 4.0 - Source %1").arg(source_index + 1));
+    }
 
     source_type = static_cast<source_t>(settings->value(QString("cam_model")).toInt());
 
+    // All sources share the global thread pool, make room for this one's loops before the
+    // camera (e.g. the XIO reader) starts using it.
+    QThreadPool::globalInstance()->setMaxThreadCount(
+                QThreadPool::globalInstance()->maxThreadCount() + POOL_THREADS_PER_SOURCE);
+
     // Load the worker thread
     workerThread = new QThread;
-    fw = new FrameWorker(settings, workerThread);
+    fw = new FrameWorker(settings, stage_pool, workerThread);
     fw->moveToThread(workerThread);
     QFutureWatcher<void> fwWatcher;
     connect(workerThread, &QThread::started, fw, &FrameWorker::captureFrames);
@@ -37,9 +48,8 @@ LVMainWindow::LVMainWindow(QSettings *settings, QWidget *parent)
 
     if (fw->running()) {
         workerThread->start();
-        DSLoop = QtConcurrent::run(fw, &FrameWorker::captureDSFrames);
-        SDLoop = QtConcurrent::run(fw, &FrameWorker::captureSDFrames);
-        fwWatcher.setFuture(SDLoop);
+        ProcLoop = QtConcurrent::run(fw, &FrameWorker::processFrames);
+        fwWatcher.setFuture(ProcLoop);
         // connect(&fwWatcher, &QFutureWatcher<void>::finished, fw, &FrameWorker::deleteLater);
         connect(fw, &FrameWorker::finished, fw, &FrameWorker::deleteLater);
     } else {
@@ -74,7 +84,8 @@ LVMainWindow::LVMainWindow(QSettings *settings, QWidget *parent)
     tab_widget->addTab(spat_mean_display, QString("Spatial Mean"));
     tab_widget->addTab(fft_display, QString("FFT of Plane Mean"));
 
-    server = new SaveServer(this);
+    // Each source needs its own port, by default they count up from 50000.
+    server = new SaveServer(quint16(settings->value(QString("save_port"), 50000 + source_index).toUInt()), this);
     connect(server, &SaveServer::startSavingRemote,
             fw, &FrameWorker::captureFramesRemote);
 
@@ -99,30 +110,51 @@ LVMainWindow::LVMainWindow(QSettings *settings, QWidget *parent)
     createMenus();
 
     camDialog = new CameraViewDialog(fw->Camera);
+    statsDialog = new PipelineStatsDialog(fw);
 
     compDialog = new ComputeDevDialog(fw->STDFilter->getDeviceList());
     connect(compDialog, &ComputeDevDialog::device_changed,
             this, &LVMainWindow::change_compute_device);
 
-    dsfDialog = new DSFPrefDialog();
+    dsfDialog = new DSFPrefDialog(settings->value(QString("mask_lossless"), false).toBool());
     connect(dsfDialog, &DSFPrefDialog::applyMaskFromFile,
             fw, &FrameWorker::applyMask);
     connect(dsfDialog, &DSFPrefDialog::accepted, fw, [this](){
         fw->setMaskSettings(dsfDialog->getMaskFile(),
-                            dsfDialog->getAvgdFrames());
+                            dsfDialog->getAvgdFrames(),
+                            dsfDialog->getLossless());
+    });
+    connect(dsfDialog, &DSFPrefDialog::accepted, this, [this](){
+        settings->setValue(QString("mask_lossless"), dsfDialog->getLossless());
     });
 
-    fpsDialog = new FrameRateDialog(int(1000.0 / fw->getFramePeriod()));
+    fpsDialog = new FrameRateDialog(int(1000.0 / fw->getFramePeriod()), int(fw->getPacingMode()));
     connect(fpsDialog, &FrameRateDialog::framerate_changed,
             this, [this](int frame_period){
                 fw->setFramePeriod(double(1000.0 / frame_period));
     });
+    connect(fpsDialog, &FrameRateDialog::pacing_changed,
+            this, [this](int mode){
+                fw->setPacingMode(mode);
+                settings->setValue(QString("playback_pacing"), mode);
+    });
+
+    ringDialog = new RingBufferDialog(fw, settings->value(QString("ring_budget_mb"), 1024).toInt(),
+                                      settings->value(QString("ring_slack_ms"), 2000).toInt());
+    connect(ringDialog, &RingBufferDialog::budget_changed,
+            this, [this](int budget_mb, int slack_ms){
+                fw->setRingBudget(budget_mb, slack_ms);
+                settings->setValue(QString("ring_budget_mb"), budget_mb);
+                settings->setValue(QString("ring_slack_ms"), slack_ms);
+    });
     notInitialized = false;
 }
 
 LVMainWindow::~LVMainWindow()
 {
     if (notInitialized) {
+        QThreadPool::globalInstance()->setMaxThreadCount(
+                    QThreadPool::globalInstance()->maxThreadCount() - POOL_THREADS_PER_SOURCE);
         return;
     }
     delete cbox;
@@ -136,14 +168,16 @@ LVMainWindow::~LVMainWindow()
     delete spat_mean_display;
     delete fft_display;
     delete camDialog;
+    delete statsDialog;
     delete compDialog;
     delete dsfDialog;
     delete fpsDialog;
+    delete ringDialog;
     fw->stop();
-    if (DSLoop.isStarted())
-        DSLoop.waitForFinished();
-    if (SDLoop.isStarted())
-        SDLoop.waitForFinished();
+    if (ProcLoop.isStarted())
+        ProcLoop.waitForFinished();
+    QThreadPool::globalInstance()->setMaxThreadCount(
+                QThreadPool::globalInstance()->maxThreadCount() - POOL_THREADS_PER_SOURCE);
 }
 
 void LVMainWindow::createActions()
@@ -168,10 +202,21 @@ void LVMainWindow::createActions()
     resetAct->setStatusTip("Restart the data stream");
     connect(resetAct, &QAction::triggered, this, &LVMainWindow::reset);
 
+    addSourceAct = new QAction("Add Source &Window...", this);
+    addSourceAct->setShortcut(QKeySequence("Ctrl+Shift+N"));
+    addSourceAct->setStatusTip("Open another camera source next to this one");
+    connect(addSourceAct, &QAction::triggered, this, &LVMainWindow::addSourceRequested);
+
+    closeSourceAct = new QAction("&Close Source Window", this);
+    closeSourceAct->setShortcuts(QKeySequence::Close);
+    closeSourceAct->setStatusTip("Stop this camera source and close its window");
+    connect(closeSourceAct, &QAction::triggered, this, &QWidget::close);
+
+    // Closes the windows of every source, not just this one.
     exitAct = new QAction("E&xit", this);
     exitAct->setShortcuts(QKeySequence::Quit);
     exitAct->setStatusTip("Exit LiveView");
-    connect(exitAct, &QAction::triggered, this, &QWidget::close);
+    connect(exitAct, &QAction::triggered, this, &LVMainWindow::quitRequested);
 
     compAct = new QAction("Change Compute Device...", this);
     compAct->setStatusTip("Use a different computing type for OpenCL calculations.");
@@ -185,6 +230,12 @@ void LVMainWindow::createActions()
         fpsDialog->show();
     });
 
+    ringAct = new QAction("Frame Buffer...", this);
+    ringAct->setStatusTip("Change how much memory and time the frame buffer holds for the recorder.");
+    connect(ringAct, &QAction::triggered, this, [this]() {
+        ringDialog->show();
+    });
+
     dsfAct = new QAction("Dark Subtraction", this);
     dsfAct->setShortcut(QKeySequence::Underline); // This specifies the Ctrl+U key combo.
     dsfAct->setStatusTip("Modify settings when collecting dark subtraction frames.");
@@ -289,6 +340,68 @@ void LVMainWindow::createActions()
     BILact->setChecked(true);
     cbox->bit_org = fwBIL;
 
+    playActGroup = new QActionGroup(this);
+    playAct = new QAction("&Play", this);
+    playAct->setShortcut(QKeySequence("Ctrl+Right"));
+    playAct->setStatusTip("Play the file forward.");
+    playAct->setCheckable(true);
+    playAct->setChecked(true);
+    connect(playAct, &QAction::triggered, this, [this]() {
+        fw->setPlayback(1);
+    });
+    reverseAct = new QAction("Play &Reverse", this);
+    reverseAct->setShortcut(QKeySequence("Ctrl+Left"));
+    reverseAct->setStatusTip("Play the file backward.");
+    reverseAct->setCheckable(true);
+    connect(reverseAct, &QAction::triggered, this, [this]() {
+        fw->setPlayback(-1);
+    });
+    pauseAct = new QAction("P&ause", this);
+    pauseAct->setShortcut(QKeySequence("Ctrl+Space"));
+    pauseAct->setStatusTip("Hold the current frame.");
+    pauseAct->setCheckable(true);
+    connect(pauseAct, &QAction::triggered, this, [this]() {
+        fw->setPlayback(0);
+    });
+    playActGroup->addAction(playAct);
+    playActGroup->addAction(reverseAct);
+    playActGroup->addAction(pauseAct);
+
+    stepFwdAct = new QAction("Step &Forward", this);
+    stepFwdAct->setShortcut(QKeySequence(Qt::Key_Period));
+    stepFwdAct->setStatusTip("Pause and advance by one frame.");
+    connect(stepFwdAct, &QAction::triggered, this, [this]() {
+        pauseAct->setChecked(true);
+        fw->stepFrames(1);
+    });
+    stepBackAct = new QAction("Step &Back", this);
+    stepBackAct->setShortcut(QKeySequence(Qt::Key_Comma));
+    stepBackAct->setStatusTip("Pause and go back by one frame.");
+    connect(stepBackAct, &QAction::triggered, this, [this]() {
+        pauseAct->setChecked(true);
+        fw->stepFrames(-1);
+    });
+
+    gotoAct = new QAction("&Go to Frame...", this);
+    gotoAct->setShortcut(QKeySequence("Ctrl+G"));
+    gotoAct->setStatusTip("Jump to a frame number in the file.");
+    connect(gotoAct, &QAction::triggered, this, &LVMainWindow::goto_frame);
+    loopAct = new QAction("&Loop Range...", this);
+    loopAct->setShortcut(QKeySequence("Ctrl+L"));
+    loopAct->setStatusTip("Replay a range of frames continuously.");
+    connect(loopAct, &QAction::triggered, this, &LVMainWindow::set_loop_range);
+    noLoopAct = new QAction("&Clear Loop", this);
+    noLoopAct->setStatusTip("Stop looping and play through to the end.");
+    connect(noLoopAct, &QAction::triggered, this, [this]() {
+        fw->setLoopRange(0, -1);
+    });
+
+    statsAct = new QAction("Pipeline Statistics", this);
+    statsAct->setStatusTip("Show how many frames each processing stage handled or skipped.");
+    connect(statsAct, &QAction::triggered, this, [this]() {
+        statsDialog->show();
+    });
+
     camViewAct = new QAction("Camera Info", this);
     connect(camViewAct, &QAction::triggered, this, [this]() {
         camDialog->show();
@@ -296,11 +409,14 @@ void LVMainWindow::createActions()
     helpInfoAct = new QAction("About LiveView", this);
     connect(helpInfoAct, &QAction::triggered, this, &LVMainWindow::show_about_window);
 
-    // Not relevant to CameraLink
-    if (source_type == CAMERA_LINK) {
+    // Not relevant to live sources (CameraLink, shared memory, network) or the simulator, which paces itself
+    if (source_type == CAMERA_LINK || source_type == SIM || source_type == SHM || source_type == NET) {
         openAct->setEnabled(false);
         resetAct->setEnabled(false);
         fpsAct->setEnabled(false);
+        for (auto act : {playAct, reverseAct, pauseAct, stepFwdAct, stepBackAct, gotoAct, loopAct, noLoopAct}) {
+            act->setEnabled(false);
+        }
     }
 }
 
@@ -316,6 +432,8 @@ void LVMainWindow::createMenus()
     formatSubMenu->addAction(BIPact);
     formatSubMenu->addAction(BSQact);
     fileMenu->addAction(resetAct);
+    fileMenu->addAction(addSourceAct);
+    fileMenu->addAction(closeSourceAct);
     // These two items will not appear in MacOS because they are handled automatically by the
     // application menu.
     fileMenu->addSeparator();
@@ -324,6 +442,7 @@ void LVMainWindow::createMenus()
     prefMenu = menuBar()->addMenu("&Computation");
     prefMenu->addAction(compAct);
     prefMenu->addAction(fpsAct);
+    prefMenu->addAction(ringAct);
     prefMenu->addAction(dsfAct);
     inversionSubMenu = prefMenu->addMenu("Remap Pixels");
     inversionSubMenu->addAction(remap14Act);
@@ -337,8 +456,21 @@ void LVMainWindow::createMenus()
     gradientSubMenu = viewMenu->addMenu("&Gradient");
     gradientSubMenu->addActions(gradActs);
 
+    playbackMenu = menuBar()->addMenu("&Playback");
+    playbackMenu->addAction(playAct);
+    playbackMenu->addAction(reverseAct);
+    playbackMenu->addAction(pauseAct);
+    playbackMenu->addSeparator();
+    playbackMenu->addAction(stepFwdAct);
+    playbackMenu->addAction(stepBackAct);
+    playbackMenu->addAction(gotoAct);
+    playbackMenu->addSeparator();
+    playbackMenu->addAction(loopAct);
+    playbackMenu->addAction(noLoopAct);
+
     aboutMenu = menuBar()->addMenu("&Help");
     aboutMenu->addAction(camViewAct);
+    aboutMenu->addAction(statsAct);
     aboutMenu->addAction(helpInfoAct);
 
 }
@@ -425,6 +557,43 @@ void LVMainWindow::reset()
     }
 }
 
+void LVMainWindow::goto_frame()
+{
+    const qint64 nFrames = fw->Camera->frameCount();
+    if (nFrames <= 0) {
+        return;
+    }
+    bool ok = false;
+    int frame = QInputDialog::getInt(this, "Go to Frame",
+                                     QString("Frame number (0 to %1):").arg(nFrames - 1),
+                                     int(std::max<qint64>(fw->Camera->currentFrame(), 0)),
+                                     0, int(std::min<qint64>(nFrames - 1, INT_MAX)), 1, &ok);
+    if (ok) {
+        fw->seekFrame(frame);
+    }
+}
+
+void LVMainWindow::set_loop_range()
+{
+    bool ok = false;
+    QString range = QInputDialog::getText(this, "Loop Range",
+                                          "First and last frame to loop over (e.g. 1200-1500):",
+                                          QLineEdit::Normal, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+    QStringList ends = range.split("-", QString::SkipEmptyParts);
+    bool first_ok = false, last_ok = false;
+    qint64 first = ends.size() == 2 ? ends.at(0).trimmed().toLongLong(&first_ok) : 0;
+    qint64 last = ends.size() == 2 ? ends.at(1).trimmed().toLongLong(&last_ok) : 0;
+    if (!first_ok || !last_ok || first > last) {
+        QMessageBox::warning(this, "Loop Range", "Please enter the range as first-last, e.g. 1200-1500.");
+        return;
+    }
+    fw->setLoopRange(first, last);
+    fw->seekFrame(fw->Camera->playDirection() > 0 ? first : last);
+}
+
 void LVMainWindow::change_compute_device(const QString &dev_name)
 {
     fw->STDFilter->change_device(dev_name);
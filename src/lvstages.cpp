@@ -0,0 +1,101 @@
+#include "lvstage.h"
+#include "frameworker.h"
+#include "lvframebuffer.h"
+
+/* The processing stages LiveView ships with. Dark subtraction feeds the mean profiles, the
+ * standard deviation feeds the SNR, and the two chains run side by side. Each product is
+ * published to the displays once everything reading it is done with the frame. */
+
+class DarkSubStage : public LVStage
+{
+public:
+    explicit DarkSubStage(FrameWorker *fw) : fw(fw) {}
+
+    bool process(StageContext &ctx) override
+    {
+        LVFrame *dsf_frame = fw->frameBuffer()->bindDSF(ctx.rawIndex());
+        fw->DSFilter->dsf_callback(dsf_frame->raw_data, dsf_frame->dsf_data);
+        ctx.setOutput(dsf_frame);
+        return true;
+    }
+
+    // Refused if the raw frame was overwritten while we were at it.
+    bool finish(StageContext &ctx) override
+    {
+        (void)ctx;
+        return fw->frameBuffer()->setDSF();
+    }
+
+private:
+    FrameWorker *fw;
+};
+
+class MeanStage : public LVStage
+{
+public:
+    explicit MeanStage(FrameWorker *fw) : fw(fw) {}
+
+    std::vector<std::string> inputs() const override { return {"dark_subtract"}; }
+
+    bool process(StageContext &ctx) override
+    {
+        fw->MEFilter->compute_mean(ctx.input(0), fw->topLeft, fw->bottomRight,
+                                   fw->getPlotMode(), fw->Camera->isRunning());
+        return true;
+    }
+
+private:
+    FrameWorker *fw;
+};
+
+class StdDevStage : public LVStage
+{
+public:
+    explicit StdDevStage(FrameWorker *fw) : fw(fw) {}
+
+    bool process(StageContext &ctx) override
+    {
+        if (!fw->STDFilter->isReadyRead()) {
+            return false;
+        }
+        LVFrame *std_frame = fw->frameBuffer()->bindSTD(ctx.rawIndex());
+        fw->STDFilter->compute_stddev(std_frame, fw->getStdDevN());
+        // Only worth showing once the history window has filled up.
+        if (fw->STDFilter->isReadyDisplay()) {
+            ctx.setOutput(std_frame);
+        }
+        return true;
+    }
+
+    bool finish(StageContext &ctx) override
+    {
+        return !ctx.output() || fw->frameBuffer()->setSTD();
+    }
+
+private:
+    FrameWorker *fw;
+};
+
+class SNRStage : public LVStage
+{
+public:
+    explicit SNRStage(FrameWorker *fw) : fw(fw) {}
+
+    std::vector<std::string> inputs() const override { return {"stddev"}; }
+
+    bool process(StageContext &ctx) override
+    {
+        if (ctx.input(0)) {
+            fw->compute_snr(ctx.input(0));
+        }
+        return true;
+    }
+
+private:
+    FrameWorker *fw;
+};
+
+LV_REGISTER_STAGE("dark_subtract", DarkSubStage);
+LV_REGISTER_STAGE("mean", MeanStage);
+LV_REGISTER_STAGE("stddev", StdDevStage);
+LV_REGISTER_STAGE("snr", SNRStage);
@@ -5,14 +5,22 @@
 #include <QStyle>
 #include <QTextStream>
 #include <QFileInfo>
+#include <QMap>
+#include <QPointer>
+#include <QThreadPool>
 #include <cameraselectdialog.h>
 
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <csignal>
+#include <algorithm>
+#include <functional>
+#include <thread>
 
 #include "lvmainwindow.h"
+#include "osutils.h"
+#include "workstealpool.h"
 
 #ifndef HOST
 #define HOST "unknown location"
@@ -45,7 +53,8 @@ int main(int argc, char* argv[])
 
     if (bind(sfd, reinterpret_cast<struct sockaddr*>(&lv_addr), sizeof(lv_addr)) == -1) {
         auto reply = QMessageBox::question(nullptr, "LiveView Cannot Start",
-                            "Only one instance of LiveView should be run at a time. Multiple instances can cause errors. Would you like to continue anyways?",
+                            "Only one instance of LiveView should be run at a time. Multiple instances can cause errors. "
+                            "To view several cameras at once, use File > Add Source Window instead. Would you like to continue anyways?",
                                            QMessageBox::Yes | QMessageBox::Cancel);
         if (reply == QMessageBox::Cancel) {
             handle_error("bind");
@@ -60,9 +69,9 @@ int main(int argc, char* argv[])
         handle_error("listen");
     }
 
-    QSettings settings(QStandardPaths::writableLocation(
-                           QStandardPaths::ConfigLocation)
-                       + "/lvconfig.ini", QSettings::IniFormat);
+    const QString config_path = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
+            + "/lvconfig.ini";
+    QSettings settings(config_path, QSettings::IniFormat);
 
     if (settings.value(QString("dark"), USE_DARK_STYLE).toBool()) {
         QFile f(":qdarkstyle/style.qss");
@@ -76,41 +85,126 @@ int main(int argc, char* argv[])
         }
     }
 
-    CameraSelectDialog csd(&settings);
-    if (settings.value(QString("show_cam_dialog"), true).toBool()) {
-        int retval = csd.exec();
-        if (!retval) {
-            unlink(socket_path.data());
-            return -1;
-        }
-    }
-
     QPixmap logo_pixmap(":images/aviris-logo-transparent.png");
     QSplashScreen splash(logo_pixmap);
-    splash.show();
-    splash.showMessage(QObject::tr("Loading LiveView... Compiled on " __DATE__ ", " __TIME__ " PDT by " UNAME "@" HOST),
-                       Qt::AlignCenter | Qt::AlignBottom, Qt::gray);
 
     qDebug() << "This version (" << GIT_CURRENT_SHA1_SHORT << ") of LiveView was compiled on"
              << __DATE__ << "at" << __TIME__ << "using gcc" << __GNUC__;
     qDebug() << "The compilation was performed by" << UNAME << "@" << HOST;
 
-    LVMainWindow w(&settings);
-    if (w.notInitialized) {
-        splash.finish(&w);
-        auto ret_val = 1;
+    /*
+     * Every source gets its own window, FrameWorker and frame buffer, all in this one process.
+     * The first source keeps using the top level of lvconfig.ini, source n > 0 lives in the
+     * group [source<n>] of the same file, so every setting can differ between sources.
+     * The sources share the global QThreadPool, each window grows it by what it needs for its
+     * long running loops. The processing stages of all sources run on one pool, sized to the
+     * machine and placed by the top level stage_threads and affinity_processing settings.
+     */
+    QThreadPool::globalInstance()->setMaxThreadCount(1); // spare thread for remote save clients
+    const int stage_threads = settings.value(QString("stage_threads"),
+                                             std::max(2u, std::thread::hardware_concurrency())).toInt();
+    WorkStealingPool stage_pool(std::max(stage_threads, 1), os::parseCpuList(
+            settings.value(QString("affinity_processing"), "").toString().toStdString()));
+    QMap<int, QPointer<LVMainWindow>> windows; // by source index, null once a window is closed
+    bool quitting = false;
+    std::function<bool(int)> openSource = [&](int index) -> bool {
+        QSettings *source_settings = &settings;
+        if (index > 0) {
+            source_settings = new QSettings(config_path, QSettings::IniFormat);
+            source_settings->beginGroup(QString("source%1").arg(index));
+        }
+
+        CameraSelectDialog csd(source_settings);
+        if (index > 0) {
+            csd.setWindowTitle(QString("Select Camera Model for Source %1").arg(index + 1));
+        }
+        if (source_settings->value(QString("show_cam_dialog"), true).toBool() && !csd.exec()) {
+            if (index > 0) {
+                delete source_settings;
+            }
+            return false;
+        }
+
+        if (index == 0) {
+            splash.show();
+            splash.showMessage(QObject::tr("Loading LiveView... Compiled on " __DATE__ ", " __TIME__ " PDT by " UNAME "@" HOST),
+                               Qt::AlignCenter | Qt::AlignBottom, Qt::gray);
+        }
+
+        auto w = new LVMainWindow(source_settings, &stage_pool, index);
+        if (index > 0) {
+            source_settings->setParent(w); // deleted once the window is done with it
+        }
+        if (w->notInitialized) {
+            splash.finish(w);
+            delete w;
+            return false;
+        }
+        w->setAttribute(Qt::WA_DeleteOnClose);
+        w->setGeometry(QStyle::alignedRect(
+                          Qt::LeftToRight,
+                          Qt::AlignCenter,
+                          w->size(),
+                          a.desktop()->availableGeometry()));
+        if (index > 0) {
+            // Cascade the extra windows so that they do not hide each other completely.
+            w->move(w->pos() + QPoint(40 * index, 40 * index));
+        }
+        w->show();
+        splash.finish(w);
+        windows[index] = w;
+
+        QObject::connect(w, &LVMainWindow::addSourceRequested, [&]() {
+            // Reuse the first free slot, so that a source closed earlier comes back with its settings.
+            int next = 1;
+            while (windows.value(next)) {
+                next++;
+            }
+            if (openSource(next)) {
+                settings.setValue(QString("num_sources"),
+                                  std::max(next + 1, settings.value(QString("num_sources"), 1).toInt()));
+            }
+        });
+        QObject::connect(w, &LVMainWindow::quitRequested, [&]() {
+            // Every source is still open at this point, so they all come back on the next start.
+            quitting = true;
+            a.closeAllWindows();
+        });
+        QObject::connect(w, &QObject::destroyed, [&, index]() {
+            if (quitting || index == 0) {
+                return;
+            }
+            // A source closed while LiveView keeps running is not reopened on the next start,
+            // as long as no source after it is still open.
+            int last_open = 0;
+            for (auto it = windows.constBegin(); it != windows.constEnd(); ++it) {
+                if (it.value() && it.key() != index) {
+                    last_open = std::max(last_open, it.key());
+                }
+            }
+            if (index > last_open) {
+                settings.setValue(QString("num_sources"), last_open + 1);
+            }
+        });
+        return true;
+    };
+
+    if (!openSource(0)) {
         unlink(socket_path.data());
-        return ret_val;
+        return 1;
+    }
+    const int num_sources = std::max(1, settings.value(QString("num_sources"), 1).toInt());
+    for (int index = 1; index < num_sources; index++) {
+        if (!openSource(index)) {
+            qWarning() << "Source" << index + 1 << "did not start";
+        }
     }
-    w.setGeometry(QStyle::alignedRect(
-                      Qt::LeftToRight,
-                      Qt::AlignCenter,
-                      w.size(),
-                      a.desktop()->availableGeometry()));
-    w.show();
-    splash.finish(&w);
 
     auto ret_val = a.exec();
+    quitting = true;
+    for (auto &w : windows) {
+        delete w; // QPointer, already null for windows that were closed and deleted
+    }
     unlink(socket_path.data());
 
     return ret_val;
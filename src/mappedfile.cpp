@@ -0,0 +1,101 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <QDebug>
+
+MappedFile::MappedFile() :
+    fd(-1), addr(nullptr), length(0),
+    page_size(size_t(sysconf(_SC_PAGESIZE)))
+{}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &fname)
+{
+    close();
+
+    fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd == -1) {
+        qDebug() << "Could not open file" << fname.data() << ". Does it exist?";
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        qDebug() << "Could not determine size of" << fname.data();
+        close();
+        return false;
+    }
+    length = size_t(st.st_size);
+
+    void *map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        qDebug() << "Could not memory map" << fname.data() << ":" << strerror(errno);
+        close();
+        return false;
+    }
+    addr = static_cast<unsigned char*>(map);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (addr) {
+        munmap(addr, length);
+        addr = nullptr;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    length = 0;
+}
+
+void MappedFile::adviseSequential()
+{
+    if (addr) {
+        madvise(addr, length, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::willNeed(size_t offset, size_t len)
+{
+    if (!addr || offset >= length) {
+        return;
+    }
+    // madvise() wants a page aligned start address, so widen the range downwards.
+    size_t begin = offset - offset % page_size;
+    size_t end = std::min(length, offset + len);
+    madvise(addr + begin, end - begin, MADV_WILLNEED);
+}
+
+void MappedFile::dontNeed(size_t offset, size_t len)
+{
+    if (!addr || offset >= length) {
+        return;
+    }
+    // Only drop whole pages that lie entirely inside the range, anything else may still be in use.
+    size_t begin = (offset + page_size - 1) / page_size * page_size;
+    size_t end = std::min(length, offset + len);
+    end -= end % page_size;
+    if (end <= begin) {
+        return;
+    }
+    madvise(addr + begin, end - begin, MADV_DONTNEED);
+#ifdef __linux__
+    // Also evict the pages from the page cache, otherwise a long flight line will push
+    // everything else out of memory even though we never look at those pages again.
+    posix_fadvise(fd, off_t(begin), off_t(end - begin), POSIX_FADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,451 @@
+#include "netcamera.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Longest we block in acquireFrame(), so that FrameWorker keeps handling its events.
+static const int WAIT_MS = 100;
+// How long a partly received frame may hold up finished frames behind it.
+static const int REASSEMBLY_MS = 50;
+// Datagrams read per recvmmsg() call.
+static const int RECV_BATCH = 64;
+// Receive timeout on the sockets, i.e. how quickly the receiver notices that it should stop.
+static const int SOCKET_POLL_MS = 100;
+// Smallest fragment payload we reserve reassembly bookkeeping for up front.
+static const size_t MIN_FRAGMENT = 512;
+static char net_name[] = "Network stream";
+
+using namespace std::chrono;
+
+NetCamera::NetCamera(int frWidth, int frHeight, int dataHeight,
+                     net_proto_t proto, const std::string &bind_addr, int port,
+                     int pool_frames, int rcvbuf_mb, int timeout_ms, QObject *parent) :
+    CameraModel(parent), frSize(size_t(frWidth * dataHeight)), proto(proto),
+    bind_addr(bind_addr), port(port), rcvbuf_bytes(rcvbuf_mb * 1024 * 1024),
+    tmoutPeriod(std::max(timeout_ms, WAIT_MS)), sock_fd(-1), conn_fd(-1), stopping(false),
+    delivered_seq(0), warned_geometry(false), leased(nullptr), last_stamp(-1), no_data(true),
+    dropped(0), timeouts(0)
+{
+    frame_width = frWidth;
+    frame_height = frHeight;
+    data_height = dataHeight;
+    camera_name = net_name;
+    camera_type = NET_STREAM;
+    source_type = NET;
+
+    // Everything the receiver touches per frame is allocated here, once.
+    const size_t max_frags = (frSize * sizeof(uint16_t) + MIN_FRAGMENT - 1) / MIN_FRAGMENT;
+    pool.resize(size_t(std::max(pool_frames, 2)));
+    for (auto &entry : pool) {
+        entry.state = ENTRY_FREE;
+        entry.seq = 0;
+        entry.frag_bits.reserve((max_frags + 63) / 64);
+        entry.frame.assign(frSize, 0);
+    }
+    dummy.assign(frSize, 0);
+    temp_frame.assign(frSize, 0);
+}
+
+NetCamera::~NetCamera()
+{
+    running.store(false);
+    stopping.store(true);
+    int fd = conn_fd.load();
+    if (fd != -1) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+    closeSockets();
+}
+
+bool NetCamera::start()
+{
+    if (!openSocket()) {
+        closeSockets();
+        return false;
+    }
+    receiver = std::thread(proto == NET_TCP ? &NetCamera::tcpLoop : &NetCamera::udpLoop, this);
+    last_arrival = steady_clock::now();
+    running.store(true);
+    emit started();
+    return true;
+}
+
+bool NetCamera::openSocket()
+{
+    sock_fd = socket(AF_INET, proto == NET_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sock_fd == -1) {
+        qWarning() << "Unable to create network socket:" << strerror(errno);
+        return false;
+    }
+    int one = 1;
+    setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // A deep socket buffer rides out the moments when the receiver thread is not scheduled.
+    // The kernel caps it at net.core.rmem_max.
+    setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes, sizeof(rcvbuf_bytes));
+    struct timeval tv = { 0, SOCKET_POLL_MS * 1000 };
+    setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    if (inet_pton(AF_INET, bind_addr.c_str(), &addr.sin_addr) != 1) {
+        qWarning() << "Invalid network bind address" << bind_addr.data();
+        return false;
+    }
+    if (bind(sock_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        qWarning() << "Unable to bind to" << bind_addr.data() << "port" << port << ":" << strerror(errno);
+        return false;
+    }
+    if (proto == NET_TCP && listen(sock_fd, 1) == -1) {
+        qWarning() << "Unable to listen on port" << port << ":" << strerror(errno);
+        return false;
+    }
+    qDebug() << "Waiting for" << (proto == NET_TCP ? "TCP" : "UDP") << "frames on"
+             << bind_addr.data() << "port" << port;
+    return true;
+}
+
+void NetCamera::closeSockets()
+{
+    if (sock_fd != -1) {
+        close(sock_fd);
+        sock_fd = -1;
+    }
+}
+
+uint16_t* NetCamera::getFrame()
+{
+    uint16_t *frame = acquireFrame(temp_frame.data());
+    if (frame != temp_frame.data()) {
+        std::copy(frame, frame + frSize, temp_frame.begin());
+    }
+    releaseFrame(frame);
+    return temp_frame.data();
+}
+
+uint16_t* NetCamera::acquireFrame(uint16_t *slot)
+{
+    Q_UNUSED(slot);
+    std::unique_lock<std::mutex> lock(pool_lock);
+    const auto deadline = steady_clock::now() + milliseconds(WAIT_MS);
+    pool_entry_t *entry;
+    while (!(entry = nextDeliverable()) && steady_clock::now() < deadline) {
+        // Wake up now and then even without news, a stalled partial frame may have expired.
+        frame_ready.wait_for(lock, milliseconds(10));
+    }
+
+    if (!entry) {
+        lock.unlock();
+        no_data = true;
+        last_stamp = -1;
+        if (running.load() && steady_clock::now() - last_arrival > tmoutPeriod) {
+            running.store(false);
+            timeouts++;
+            emit timeout();
+        }
+        return dummy.data();
+    }
+
+    if (delivered_seq && entry->seq > delivered_seq + 1) {
+        dropped += entry->seq - delivered_seq - 1;
+    }
+    delivered_seq = entry->seq;
+    entry->state = ENTRY_LEASED;
+    leased = entry;
+    lock.unlock();
+
+    last_stamp = entry->timestamp_ns;
+    no_data = false;
+    last_arrival = steady_clock::now();
+    if (!running.load()) {
+        running.store(true);
+        emit started();
+    }
+    return entry->frame.data();
+}
+
+void NetCamera::releaseFrame(uint16_t *frame)
+{
+    if (!leased || frame != leased->frame.data()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pool_lock);
+    leased->state = ENTRY_FREE;
+    leased = nullptr;
+}
+
+NetCamera::pool_entry_t* NetCamera::nextDeliverable()
+{
+    pool_entry_t *ready = nullptr;
+    for (auto &entry : pool) {
+        if (entry.state == ENTRY_READY && (!ready || entry.seq < ready->seq)) {
+            ready = &entry;
+        }
+    }
+    if (!ready) {
+        return nullptr;
+    }
+    // Frames go out in order, so an earlier frame that is still arriving holds this one back,
+    // but only for so long. Once it expires it is given up and counted as lost.
+    const auto now = steady_clock::now();
+    for (auto &entry : pool) {
+        if (entry.state == ENTRY_FILLING && entry.seq < ready->seq) {
+            if (now - entry.first_seen < milliseconds(REASSEMBLY_MS)) {
+                return nullptr;
+            }
+            entry.state = ENTRY_FREE;
+        }
+    }
+    return ready;
+}
+
+NetCamera::pool_entry_t* NetCamera::claimEntry(uint64_t seq)
+{
+    if (seq <= delivered_seq) {
+        if (delivered_seq - seq < pool.size()) {
+            return nullptr; // a late or repeated piece of a frame we are done with
+        }
+        // Far behind anything we could still be holding, so the sender started over.
+        qDebug() << "Network frame sequence restarted at" << seq;
+        delivered_seq = seq - 1;
+        for (auto &entry : pool) {
+            if (entry.state != ENTRY_LEASED) {
+                entry.state = ENTRY_FREE;
+            }
+        }
+    }
+
+    pool_entry_t *free_entry = nullptr;
+    pool_entry_t *oldest = nullptr;
+    for (auto &entry : pool) {
+        if (entry.state == ENTRY_FREE) {
+            free_entry = free_entry ? free_entry : &entry;
+        } else if (entry.seq == seq) {
+            // Already being assembled, or done and a repeat
+            return entry.state == ENTRY_FILLING ? &entry : nullptr;
+        } else if (entry.state != ENTRY_LEASED && (!oldest || recycleBefore(entry, *oldest))) {
+            oldest = &entry;
+        }
+    }
+    if (!free_entry) {
+        // The display is behind, or frames are not completing. Recycle the oldest unfinished frame,
+        // or failing that the oldest finished one. Either shows up as a gap in the sequence.
+        if (!oldest || oldest->seq > seq) {
+            return nullptr;
+        }
+        free_entry = oldest;
+    }
+    free_entry->state = ENTRY_FILLING;
+    free_entry->seq = seq;
+    free_entry->timestamp_ns = -1;
+    free_entry->frags_seen = 0;
+    free_entry->frag_count = 0;
+    free_entry->first_seen = steady_clock::now();
+    return free_entry;
+}
+
+bool NetCamera::recycleBefore(const pool_entry_t &a, const pool_entry_t &b)
+{
+    if (a.state != b.state) {
+        return a.state == ENTRY_FILLING;
+    }
+    return a.seq < b.seq;
+}
+
+void NetCamera::publish(pool_entry_t *entry)
+{
+    entry->state = ENTRY_READY;
+    frame_ready.notify_one();
+}
+
+void NetCamera::handleFragment(const unsigned char *data, size_t len)
+{
+    netframe::fragment_header_t hdr;
+    if (len < sizeof(hdr)) {
+        return;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    const size_t payload = len - sizeof(hdr);
+    const size_t frame_bytes = frSize * sizeof(uint16_t);
+    if (hdr.magic != netframe::MAGIC) {
+        return;
+    }
+    if (hdr.frame_bytes != frame_bytes) {
+        if (!warned_geometry) {
+            qWarning() << "Dropping network frames of" << hdr.frame_bytes << "bytes, expected"
+                       << frame_bytes << "- check the frame geometry";
+            warned_geometry = true;
+        }
+        return;
+    }
+    if (hdr.frag_count == 0 || hdr.frag_index >= hdr.frag_count || payload == 0
+            || size_t(hdr.offset) + payload > frame_bytes) {
+        return;
+    }
+
+    pool_entry_t *entry = claimEntry(hdr.seq);
+    if (!entry) {
+        return;
+    }
+    if (entry->frag_count == 0) {
+        entry->frag_count = hdr.frag_count;
+        entry->frag_bits.assign((hdr.frag_count + 63) / 64, 0);
+        entry->timestamp_ns = hdr.timestamp_ns;
+    } else if (entry->frag_count != hdr.frag_count) {
+        return;
+    }
+    uint64_t &bits = entry->frag_bits[hdr.frag_index / 64];
+    const uint64_t bit = uint64_t(1) << (hdr.frag_index % 64);
+    if (bits & bit) {
+        return; // duplicate datagram
+    }
+    memcpy(reinterpret_cast<unsigned char*>(entry->frame.data()) + hdr.offset, data + sizeof(hdr), payload);
+    bits |= bit;
+    if (++entry->frags_seen == entry->frag_count) {
+        publish(entry);
+    }
+}
+
+void NetCamera::udpLoop()
+{
+    std::vector<unsigned char> buffers(size_t(RECV_BATCH) * netframe::MAX_DATAGRAM);
+#ifdef __linux__
+    // One syscall picks up a whole batch of datagrams, which is what keeps up with a full rate stream.
+    std::vector<struct mmsghdr> msgs(RECV_BATCH);
+    std::vector<struct iovec> iovs(RECV_BATCH);
+    for (int i = 0; i < RECV_BATCH; i++) {
+        iovs[size_t(i)].iov_base = &buffers[size_t(i) * netframe::MAX_DATAGRAM];
+        iovs[size_t(i)].iov_len = netframe::MAX_DATAGRAM;
+        memset(&msgs[size_t(i)], 0, sizeof(struct mmsghdr));
+        msgs[size_t(i)].msg_hdr.msg_iov = &iovs[size_t(i)];
+        msgs[size_t(i)].msg_hdr.msg_iovlen = 1;
+    }
+    while (!stopping.load()) {
+        // Blocks for the first datagram (or the socket timeout), then takes whatever else is queued.
+        int n = recvmmsg(sock_fd, msgs.data(), RECV_BATCH, MSG_WAITFORONE, nullptr);
+        if (n <= 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                qWarning() << "Network receive failed:" << strerror(errno);
+                usleep(SOCKET_POLL_MS * 1000);
+            }
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(pool_lock);
+        for (int i = 0; i < n; i++) {
+            if (!(msgs[size_t(i)].msg_hdr.msg_flags & MSG_TRUNC)) {
+                handleFragment(&buffers[size_t(i) * netframe::MAX_DATAGRAM], msgs[size_t(i)].msg_len);
+            }
+        }
+    }
+#else
+    while (!stopping.load()) {
+        ssize_t len = recv(sock_fd, buffers.data(), netframe::MAX_DATAGRAM, 0);
+        if (len > 0) {
+            std::lock_guard<std::mutex> lock(pool_lock);
+            handleFragment(buffers.data(), size_t(len));
+        }
+    }
+#endif
+}
+
+bool NetCamera::readFully(int fd, void *buf, size_t len)
+{
+    auto ptr = static_cast<unsigned char*>(buf);
+    while (len) {
+        ssize_t got = recv(fd, ptr, len, MSG_WAITALL);
+        if (got > 0) {
+            ptr += got;
+            len -= size_t(got);
+        } else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                   || stopping.load()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NetCamera::tcpLoop()
+{
+    const size_t frame_bytes = frSize * sizeof(uint16_t);
+    std::vector<unsigned char> discard(65536);
+
+    while (!stopping.load()) {
+        int fd = accept(sock_fd, nullptr, nullptr);
+        if (fd == -1) {
+            continue; // timed out, check whether we are stopping
+        }
+        struct timeval tv = { 0, SOCKET_POLL_MS * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes, sizeof(rcvbuf_bytes));
+        conn_fd.store(fd);
+        qDebug() << "Network frame sender connected";
+        {
+            // A new connection is a new stream, its numbering starts over.
+            std::lock_guard<std::mutex> lock(pool_lock);
+            delivered_seq = 0;
+            for (auto &entry : pool) {
+                if (entry.state != ENTRY_LEASED) {
+                    entry.state = ENTRY_FREE;
+                }
+            }
+        }
+
+        netframe::frame_header_t hdr;
+        while (readFully(fd, &hdr, sizeof(hdr))) {
+            if (hdr.magic != netframe::MAGIC || hdr.version != netframe::VERSION) {
+                // There is no way to find the next frame boundary in a byte stream.
+                qWarning() << "Bad frame header on the network stream, dropping the connection";
+                break;
+            }
+            pool_entry_t *entry = nullptr;
+            if (hdr.payload_bytes == frame_bytes && int(hdr.width) == frame_width
+                    && int(hdr.data_height) == data_height) {
+                std::lock_guard<std::mutex> lock(pool_lock);
+                entry = claimEntry(hdr.seq);
+            } else if (!warned_geometry) {
+                qWarning() << "Dropping network frames of" << hdr.width << "x" << hdr.data_height
+                           << "- check the frame geometry";
+                warned_geometry = true;
+            }
+
+            if (!entry) {
+                uint64_t left = hdr.payload_bytes;
+                bool ok = true;
+                while (left && ok) {
+                    size_t chunk = size_t(std::min<uint64_t>(left, discard.size()));
+                    ok = readFully(fd, discard.data(), chunk);
+                    left -= chunk;
+                }
+                if (!ok) {
+                    break;
+                }
+                continue;
+            }
+
+            // The entry is ours while it is filling, so the payload goes straight into it.
+            bool ok = readFully(fd, entry->frame.data(), frame_bytes);
+            std::lock_guard<std::mutex> lock(pool_lock);
+            if (!ok) {
+                entry->state = ENTRY_FREE;
+                break;
+            }
+            entry->timestamp_ns = hdr.timestamp_ns;
+            publish(entry);
+        }
+
+        conn_fd.store(-1);
+        close(fd);
+        qDebug() << "Network frame sender disconnected";
+    }
+}
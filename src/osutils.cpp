@@ -1,5 +1,15 @@
 #include "osutils.h"
 
+#include <cstdio>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 void os::listdir(std::vector<std::string> &out, const std::string &directory)
 {
     DIR *dir;
@@ -14,13 +24,22 @@ void os::listdir(std::vector<std::string> &out, const std::string &directory)
             if (file_name[0] == '.')
                 continue;
 
-            if (stat(full_file_name.c_str(), &st) == -1)
+#ifdef _DIRENT_HAVE_D_TYPE
+            // Most filesystems report the entry type directly, which saves a stat() per file.
+            if (ent->d_type == DT_DIR)
                 continue;
+            if (ent->d_type == DT_UNKNOWN) {
+#endif
+                if (stat(full_file_name.c_str(), &st) == -1)
+                    continue;
 
-            const bool is_directory = (st.st_mode & S_IFDIR) != 0;
+                const bool is_directory = (st.st_mode & S_IFDIR) != 0;
 
-            if (is_directory)
-                continue;
+                if (is_directory)
+                    continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+            }
+#endif
 
             out.push_back(full_file_name);
         }
@@ -44,3 +63,92 @@ std::string os::trim(const std::string &value)
 {
     return std::regex_replace(value, std::regex("^ +| +$|( ) +"), "$1");
 }
+
+std::vector<int> os::parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = trim(item);
+        if (item.empty())
+            continue;
+        int first = -1;
+        int last = -1;
+        if (sscanf(item.c_str(), "%d-%d", &first, &last) == 1)
+            last = first;
+        if (first < 0 || last < first)
+            continue;
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool os::pinThread(const std::vector<int> &cpus, std::vector<int> *previous)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    if (previous) {
+        previous->clear();
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set))
+                    previous->push_back(cpu);
+            }
+        }
+    }
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    (void)previous;
+    return false;
+#endif
+}
+
+int os::cpuNode(int cpu)
+{
+#ifdef __linux__
+    // cpuN links to the node it is on as nodeM.
+    const std::string cpu_dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(cpu_dir.c_str());
+    if (dir == nullptr)
+        return -1;
+    int node = -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (sscanf(ent->d_name, "node%d", &node) == 1)
+            break;
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+bool os::bindToNode(void *addr, size_t len, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    // MPOL_PREFERRED from <numaif.h>, which would drag in libnuma. Preferred rather than bound,
+    // so that a full node spills over instead of failing the allocation.
+    const int mpol_preferred = 1;
+    if (node < 0 || node >= 64)
+        return false;
+    unsigned long nodemask = 1UL << node;
+    return syscall(SYS_mbind, addr, len, mpol_preferred, &nodemask, sizeof(nodemask) * 8 + 1, 0) == 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return false;
+#endif
+}
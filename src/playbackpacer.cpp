@@ -0,0 +1,97 @@
+#include "playbackpacer.h"
+
+#include <cerrno>
+#include <ctime>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+PlaybackPacer::PlaybackPacer() :
+    mode(PACE_FIXED), period_ns(25000000), restart(true),
+    deadline(0), anchor_wall(0), anchor_frame(-1), last_frame(-1), late_frames(0)
+{}
+
+void PlaybackPacer::setMode(pace_mode_t new_mode)
+{
+    mode.store(new_mode);
+    restart.store(true);
+}
+
+void PlaybackPacer::setPeriod(double period_ms)
+{
+    period_ns.store(period_ms > 0.0 ? int64_t(period_ms * 1e6) : 0);
+    restart.store(true);
+}
+
+void PlaybackPacer::reset()
+{
+    restart.store(true);
+}
+
+int64_t PlaybackPacer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PlaybackPacer::wait(int64_t frame_ns)
+{
+    const pace_mode_t m = mode.load();
+    if (m == PACE_UNTHROTTLED) {
+        return;
+    }
+    const int64_t t = now();
+    if (restart.exchange(false)) {
+#ifdef __linux__
+        // The default 50 us timer slack would swamp sub-millisecond periods.
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+        deadline = t;
+        anchor_wall = t;
+        anchor_frame = (m == PACE_TIMESTAMPS) ? frame_ns : -1;
+        last_frame = anchor_frame;
+        late_frames = 0;
+        return;
+    }
+
+    const int64_t period = period_ns.load();
+    if (m == PACE_TIMESTAMPS && frame_ns >= 0) {
+        // Re-anchor on the first stamped frame, and whenever the stamps run backwards or
+        // jump by more than the resync window (a new recording, or the file wrapped around).
+        if (anchor_frame < 0 || frame_ns < last_frame || frame_ns - last_frame > RESYNC_NS) {
+            anchor_wall = deadline + period;
+            anchor_frame = frame_ns;
+        }
+        deadline = anchor_wall + (frame_ns - anchor_frame);
+        last_frame = frame_ns;
+    } else {
+        deadline += period;
+        anchor_frame = -1;
+    }
+
+    if (t > deadline) {
+        late_frames++;
+        if (t - deadline > RESYNC_NS) {
+            deadline = t;
+            anchor_frame = -1;
+        }
+        return;
+    }
+    sleepUntil(deadline);
+}
+
+void PlaybackPacer::sleepUntil(int64_t deadline_ns)
+{
+#ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC on Linux, so the deadline can be handed straight to the kernel.
+    struct timespec ts;
+    ts.tv_sec = time_t(deadline_ns / 1000000000);
+    ts.tv_nsec = long(deadline_ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline_ns)));
+#endif
+}
@@ -1,14 +1,12 @@
 #include "saveserver.h"
 #include "saveclient.h"
 
-SaveServer::SaveServer(QObject *parent)
-    : QObject(parent),  port(50000),
+SaveServer::SaveServer(quint16 listen_port, QObject *parent)
+    : QObject(parent),  port(listen_port),
       tcpServer(nullptr), networkSession(nullptr)
 {
     qRegisterMetaType<save_req_t>("save_req_t");
 
-    QThreadPool::globalInstance()->setMaxThreadCount(5);
-
     QNetworkConfigurationManager manager;
     if (manager.capabilities() & QNetworkConfigurationManager::NetworkSessionRequired) {
         // Get saved network configuration
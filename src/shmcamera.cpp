@@ -0,0 +1,224 @@
+#include "shmcamera.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Longest we block in acquireFrame(), so that FrameWorker keeps handling its events.
+static const int WAIT_MS = 100;
+static char shm_name[] = "Shared memory ring";
+
+using namespace std::chrono;
+
+ShmCamera::ShmCamera(const std::string &ring_name, int timeout_ms, QObject *parent) :
+    CameraModel(parent), name(ring_name), tmoutPeriod(std::max(timeout_ms, WAIT_MS)),
+    hdr(nullptr), map_size(0), seg_dev(0), seg_ino(0),
+    next_seq(1), leased_seq(0), leased_slot(nullptr), last_stamp(-1), status(FRAME_NO_DATA),
+    dropped(0), timeouts(0)
+{
+    frame_width = 0;
+    frame_height = 0;
+    data_height = 0;
+    camera_name = shm_name;
+    camera_type = SHM_RING;
+    source_type = SHM;
+}
+
+ShmCamera::~ShmCamera()
+{
+    running.store(false);
+    detach();
+}
+
+bool ShmCamera::start()
+{
+    if (!attach()) {
+        qWarning() << "Could not attach to the shared memory ring" << name.data()
+                   << "- is the producer running?";
+        return false;
+    }
+    frame_width = int(hdr->width);
+    frame_height = int(hdr->height);
+    data_height = int(hdr->data_height);
+    dummy.assign(size_t(frame_width * data_height), 0);
+    temp_frame.assign(size_t(frame_width * data_height), 0);
+
+    // Start at the live edge rather than replaying whatever is still in the ring.
+    next_seq = hdr->write_seq.load(std::memory_order_acquire) + 1;
+    last_arrival = steady_clock::now();
+    running.store(true);
+    emit started();
+    return true;
+}
+
+bool ShmCamera::attach()
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        qDebug() << "Unable to open shared memory" << name.data() << ":" << strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || size_t(st.st_size) < sizeof(shmring::header_t)) {
+        close(fd);
+        return false;
+    }
+
+    // Map the whole segment read-write, readers register themselves as futex waiters in the header.
+    void *map = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        qDebug() << "Unable to map shared memory" << name.data() << ":" << strerror(errno);
+        return false;
+    }
+    auto h = static_cast<shmring::header_t*>(map);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->magic != shmring::MAGIC || h->version != shmring::VERSION) {
+        qDebug() << "Shared memory" << name.data() << "is not a LiveView frame ring, or not initialized yet";
+        munmap(map, size_t(st.st_size));
+        return false;
+    }
+    if (h->num_slots == 0 || h->data_height < h->height
+            || h->slot_stride < shmring::SLOT_HEADER_BYTES + shmring::frameBytes(h->width, h->data_height)
+            || shmring::segmentSize(h) > uint64_t(st.st_size)) {
+        qDebug() << "Shared memory ring" << name.data() << "has an inconsistent header";
+        munmap(map, size_t(st.st_size));
+        return false;
+    }
+    if (frame_width && (int(h->width) != frame_width || int(h->height) != frame_height
+                        || int(h->data_height) != data_height)) {
+        // The frame buffers downstream are already sized, so a new geometry needs a restart.
+        qWarning() << "Shared memory ring" << name.data() << "changed geometry, restart LiveView to follow it";
+        munmap(map, size_t(st.st_size));
+        return false;
+    }
+
+    detach();
+    hdr = h;
+    map_size = size_t(st.st_size);
+    seg_dev = st.st_dev;
+    seg_ino = st.st_ino;
+    return true;
+}
+
+void ShmCamera::detach()
+{
+    if (hdr) {
+        munmap(hdr, map_size);
+        hdr = nullptr;
+        map_size = 0;
+    }
+}
+
+bool ShmCamera::replaced()
+{
+    // A restarted producer usually unlinks the old segment and creates a new one under the same name.
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    bool changed = fstat(fd, &st) == 0 && (st.st_dev != seg_dev || st.st_ino != seg_ino);
+    close(fd);
+    return changed;
+}
+
+void ShmCamera::noFrame()
+{
+    status = FRAME_NO_DATA;
+    last_stamp = -1;
+    auto now = steady_clock::now();
+    if (running.load() && now - last_arrival > tmoutPeriod) {
+        running.store(false);
+        timeouts++;
+        emit timeout();
+    }
+    if (!running.load() && now - last_attach_try > tmoutPeriod) {
+        last_attach_try = now;
+        if ((!hdr || replaced()) && attach()) {
+            qDebug() << "Reattached to shared memory ring" << name.data();
+            next_seq = hdr->write_seq.load(std::memory_order_acquire) + 1;
+        }
+    }
+}
+
+uint16_t* ShmCamera::getFrame()
+{
+    uint16_t *frame = acquireFrame(temp_frame.data());
+    if (frame != temp_frame.data()) {
+        std::copy(frame, frame + temp_frame.size(), temp_frame.begin());
+    }
+    releaseFrame(frame);
+    return temp_frame.data();
+}
+
+uint16_t* ShmCamera::acquireFrame(uint16_t *slot)
+{
+    Q_UNUSED(slot);
+    leased_slot = nullptr;
+    if (!hdr) {
+        noFrame();
+        return dummy.data();
+    }
+
+    bool waited = false;
+    for (;;) {
+        uint32_t seen = hdr->wake.load();
+        uint64_t newest = hdr->write_seq.load(std::memory_order_acquire);
+        if (newest + 1 < next_seq) {
+            // The producer started counting from the beginning again.
+            next_seq = newest + 1;
+        }
+        if (newest >= next_seq) {
+            if (newest - next_seq >= hdr->num_slots) {
+                // Lapped, the frames in between have been overwritten. Resume at the newest one.
+                dropped += newest - next_seq;
+                next_seq = newest;
+            }
+            shmring::slot_t *s = shmring::slotFor(hdr, next_seq);
+            if (s->seq.load(std::memory_order_acquire) == next_seq) {
+                leased_slot = s;
+                leased_seq = next_seq;
+                last_stamp = s->timestamp_ns;
+                status = FRAME_OK;
+                last_arrival = steady_clock::now();
+                if (!running.load()) {
+                    running.store(true);
+                    emit started();
+                }
+                return shmring::pixels(s);
+            }
+            // Overwritten between the two loads, look at write_seq again.
+            dropped++;
+            next_seq++;
+            continue;
+        }
+        if (waited) {
+            break;
+        }
+        shmring::waitFor(hdr, seen, WAIT_MS);
+        waited = true;
+    }
+
+    noFrame();
+    return dummy.data();
+}
+
+void ShmCamera::releaseFrame(uint16_t *frame)
+{
+    if (!leased_slot || frame == dummy.data()) {
+        return;
+    }
+    // Second half of the seqlock read, the copy must be done before seq is checked again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (leased_slot->seq.load(std::memory_order_relaxed) != leased_seq) {
+        status |= FRAME_OVERRUN;
+    }
+    next_seq = leased_seq + 1;
+    leased_slot = nullptr;
+}
@@ -0,0 +1,170 @@
+#include "simcamera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const uint16_t SIM_BASELINE = 8192;
+static const uint16_t SIM_TARGET_PEAK = 24000;
+static const int SIM_TARGET_RADIUS = 9;
+static const double SIM_TARGET_WIDTH = 3.0;
+static const size_t NOISE_SPAN = 65536;
+static const size_t NOISE_STRIDE = 4099; // odd, so the window offset only repeats every NOISE_SPAN frames
+static const double DEFECT_FRACTION = 0.0005;
+static char sim_name[] = "Simulator";
+
+SimCamera::SimCamera(int frWidth, int frHeight, int dataHeight,
+                     sim_pattern_t pattern, double target_fps,
+                     double noise_sigma, bool add_defects,
+                     uint32_t seed, QObject *parent) :
+    CameraModel(parent), frSize(size_t(frWidth * dataHeight)),
+    pattern(pattern), sigma(noise_sigma), defects(add_defects),
+    frame_no(0), rng(seed)
+{
+    frame_width = frWidth;
+    frame_height = frHeight;
+    data_height = dataHeight;
+    camera_name = sim_name;
+    camera_type = SIM_PATTERN;
+    source_type = SIM;
+
+    temp_frame.resize(frSize);
+    setTargetFPS(target_fps);
+
+    if (pattern == SIM_NOISE) {
+        // Each frame is a sliding window into one large bank of samples, so every pixel sees
+        // a fresh draw per frame and the temporal standard deviation converges to sigma.
+        std::normal_distribution<double> gauss(SIM_BASELINE, sigma);
+        noise_bank.resize(frSize + NOISE_SPAN);
+        for (auto &sample : noise_bank) {
+            sample = static_cast<uint16_t>(std::min(65535.0, std::max(0.0, std::round(gauss(rng)))));
+        }
+    }
+
+    if (defects) {
+        std::uniform_int_distribution<uint32_t> where(0, uint32_t(frSize - 1));
+        size_t nDefects = std::max(size_t(1), size_t(double(frSize) * DEFECT_FRACTION));
+        for (size_t n = 0; n < nDefects; n++) {
+            dead_pixels.push_back(where(rng));
+            hot_pixels.push_back(where(rng));
+        }
+    }
+}
+
+SimCamera::~SimCamera()
+{
+    running.store(false);
+}
+
+bool SimCamera::start()
+{
+    next_deadline = std::chrono::steady_clock::now();
+    running.store(true);
+    emit started();
+    return true;
+}
+
+void SimCamera::setTargetFPS(double fps)
+{
+    if (fps > 0) {
+        period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / fps));
+    } else {
+        period = std::chrono::steady_clock::duration::zero();
+    }
+}
+
+uint16_t* SimCamera::getFrame()
+{
+    return acquireFrame(temp_frame.data());
+}
+
+uint16_t* SimCamera::acquireFrame(uint16_t *slot)
+{
+    pace();
+
+    switch (pattern) {
+    case SIM_RAMP:
+        makeRamp(slot);
+        break;
+    case SIM_NOISE:
+        makeNoise(slot);
+        break;
+    case SIM_TARGET:
+        makeTarget(slot);
+        break;
+    }
+    if (defects) {
+        applyDefects(slot);
+    }
+
+    frame_no++;
+    return slot;
+}
+
+void SimCamera::pace()
+{
+    if (period == std::chrono::steady_clock::duration::zero()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (next_deadline + period < now) {
+        // We fell more than a frame behind (e.g. the consumer stalled), so drop the
+        // backlog instead of bursting to catch up.
+        next_deadline = now;
+    } else {
+        std::this_thread::sleep_until(next_deadline);
+    }
+    next_deadline += period;
+}
+
+void SimCamera::makeRamp(uint16_t *out)
+{
+    // A horizontal ramp spanning the full 16-bit range that scrolls one column per frame.
+    const auto width = size_t(frame_width);
+    const double step = 65535.0 / double(std::max(frame_width - 1, 1));
+    for (size_t c = 0; c < width; c++) {
+        out[c] = static_cast<uint16_t>(double((c + frame_no) % width) * step);
+    }
+    for (size_t r = 1; r < size_t(data_height); r++) {
+        memcpy(out + r * width, out, width * sizeof(uint16_t));
+    }
+}
+
+void SimCamera::makeNoise(uint16_t *out)
+{
+    size_t offset = size_t(frame_no * NOISE_STRIDE) % NOISE_SPAN;
+    memcpy(out, noise_bank.data() + offset, frSize * sizeof(uint16_t));
+}
+
+void SimCamera::makeTarget(uint16_t *out)
+{
+    std::fill(out, out + frSize, SIM_BASELINE);
+
+    // The target traces a Lissajous figure so that it visits the whole frame.
+    const double margin = SIM_TARGET_RADIUS + 1;
+    const double cx = frame_width / 2.0 + (frame_width / 2.0 - margin) * std::sin(2 * M_PI * double(frame_no) / 500.0);
+    const double cy = frame_height / 2.0 + (frame_height / 2.0 - margin) * std::sin(2 * M_PI * double(frame_no) / 370.0);
+
+    const int r0 = std::max(0, int(cy) - SIM_TARGET_RADIUS);
+    const int r1 = std::min(frame_height - 1, int(cy) + SIM_TARGET_RADIUS);
+    const int c0 = std::max(0, int(cx) - SIM_TARGET_RADIUS);
+    const int c1 = std::min(frame_width - 1, int(cx) + SIM_TARGET_RADIUS);
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            double d2 = (r - cy) * (r - cy) + (c - cx) * (c - cx);
+            double value = SIM_TARGET_PEAK * std::exp(-d2 / (2 * SIM_TARGET_WIDTH * SIM_TARGET_WIDTH));
+            out[r * frame_width + c] = static_cast<uint16_t>(SIM_BASELINE + value);
+        }
+    }
+}
+
+void SimCamera::applyDefects(uint16_t *out)
+{
+    for (auto ndx : dead_pixels) {
+        out[ndx] = 0;
+    }
+    for (auto ndx : hot_pixels) {
+        out[ndx] = 65535;
+    }
+}
@@ -0,0 +1,281 @@
+#include "stagegraph.h"
+#include "workstealpool.h"
+
+#include <chrono>
+#include <thread>
+
+#include <QDebug>
+
+StageRegistry &StageRegistry::instance()
+{
+    static StageRegistry registry;
+    return registry;
+}
+
+bool StageRegistry::add(const std::string &name, factory_t factory)
+{
+    if (factories.count(name)) {
+        qWarning("Processing stage \"%s\" is registered twice, keeping the first.", name.c_str());
+        return false;
+    }
+    factories[name] = factory;
+    return true;
+}
+
+LVStage *StageRegistry::create(const std::string &name, FrameWorker *fw) const
+{
+    auto factory = factories.find(name);
+    return factory == factories.end() ? nullptr : factory->second(fw);
+}
+
+std::vector<std::string> StageRegistry::names() const
+{
+    std::vector<std::string> out;
+    for (auto &factory : factories) {
+        out.push_back(factory.first);
+    }
+    return out;
+}
+
+/* One frame on its way through the graph. A node holds on to its product until it and all
+ * of its consumers in this pass are done, then it is finished and may take the next frame.
+ * The pass is deleted when the last node is. */
+struct StageGraph::pass_t
+{
+    explicit pass_t(size_t num_nodes) :
+        admitted(num_nodes, 0), ok(num_nodes, 0), products(num_nodes, nullptr),
+        inputs_left(num_nodes), holds_left(num_nodes)
+    {}
+
+    uint64_t seq;
+    uint16_t raw_index;
+    std::function<void()> done;
+    std::vector<char> admitted;
+    std::vector<char> ok;
+    std::vector<LVFrame*> products;
+    std::vector<std::atomic<int>> inputs_left; // until the node can run
+    std::vector<std::atomic<int>> holds_left;  // until the node can be finished
+    std::atomic<int> nodes_left;
+};
+
+StageGraph::StageGraph(WorkStealingPool *pool) : pool(pool)
+{
+    closed.store(false);
+    in_flight.store(0);
+}
+
+StageGraph::~StageGraph()
+{
+    close();
+    for (auto &node : nodes) {
+        delete node->stage;
+    }
+}
+
+void StageGraph::add(const std::string &name, LVStage *stage)
+{
+    std::unique_ptr<node_t> node(new node_t);
+    node->name = name;
+    node->stage = stage;
+    node->busy.store(false);
+    node->processed.store(0);
+    node->skipped.store(0);
+    nodes.push_back(std::move(node));
+}
+
+void StageGraph::build()
+{
+    // Place a stage once everything it reads from is placed, until no more can be.
+    std::vector<std::unique_ptr<node_t>> ordered;
+    std::vector<bool> placed(nodes.size(), false);
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (placed[n]) {
+                continue;
+            }
+            std::vector<int> inputs;
+            for (auto &input : nodes[n]->stage->inputs()) {
+                for (size_t o = 0; o < ordered.size(); o++) {
+                    if (ordered[o]->name == input) {
+                        inputs.push_back(int(o));
+                        break;
+                    }
+                }
+            }
+            if (inputs.size() == nodes[n]->stage->inputs().size()) {
+                nodes[n]->inputs = inputs;
+                ordered.push_back(std::move(nodes[n]));
+                placed[n] = true;
+                progress = true;
+            }
+        }
+    }
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (!placed[n]) {
+            qWarning("Processing stage \"%s\" reads from a stage that is not running, leaving it out.",
+                     nodes[n]->name.c_str());
+            delete nodes[n]->stage;
+        }
+    }
+    nodes = std::move(ordered);
+    for (size_t n = 0; n < nodes.size(); n++) {
+        for (int input : nodes[n]->inputs) {
+            nodes[size_t(input)]->consumers.push_back(int(n));
+        }
+    }
+}
+
+bool StageGraph::submit(uint64_t seq, uint16_t raw_index, std::function<void()> done)
+{
+    // close() sets closed before it waits for in_flight, so either it waits for this pass
+    // or this pass sees closed.
+    in_flight++;
+    if (closed.load()) {
+        in_flight--;
+        return false;
+    }
+
+    pass_t *pass = new pass_t(nodes.size());
+    pass->seq = seq;
+    pass->raw_index = raw_index;
+    pass->done = done;
+
+    // Only this thread admits, so a node found idle stays ours.
+    int num_admitted = 0;
+    for (size_t n = 0; n < nodes.size(); n++) {
+        node_t &node = *nodes[n];
+        bool admit = !node.busy.load();
+        for (int input : node.inputs) {
+            admit = admit && pass->admitted[size_t(input)];
+        }
+        if (admit) {
+            node.busy.store(true);
+            pass->admitted[n] = 1;
+            num_admitted++;
+        } else {
+            node.skipped++;
+        }
+    }
+    if (num_admitted == 0) {
+        delete pass;
+        done();
+        in_flight--;
+        return true;
+    }
+
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (!pass->admitted[n]) {
+            continue;
+        }
+        int holds = 1;
+        for (int consumer : nodes[n]->consumers) {
+            holds += pass->admitted[size_t(consumer)];
+        }
+        pass->inputs_left[n].store(int(nodes[n]->inputs.size()));
+        pass->holds_left[n].store(holds);
+    }
+    pass->nodes_left.store(num_admitted);
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (pass->admitted[n] && nodes[n]->inputs.empty()) {
+            const int node = int(n);
+            pool->submit([this, pass, node]() { run(pass, node); });
+        }
+    }
+    return true;
+}
+
+void StageGraph::run(pass_t *pass, int n)
+{
+    node_t &node = *nodes[size_t(n)];
+    bool ok = true;
+    for (int input : node.inputs) {
+        ok = ok && pass->ok[size_t(input)];
+    }
+    if (ok) {
+        StageContext ctx(pass->seq, pass->raw_index, pass->products.data(), node.inputs, n);
+        ok = node.stage->process(ctx);
+    }
+    pass->ok[size_t(n)] = ok;
+
+    for (int consumer : node.consumers) {
+        if (pass->admitted[size_t(consumer)] && --pass->inputs_left[size_t(consumer)] == 0) {
+            pool->submit([this, pass, consumer]() { run(pass, consumer); });
+        }
+    }
+    for (int input : node.inputs) {
+        release(pass, input);
+    }
+    // Last, this may be what ends the pass.
+    release(pass, n);
+}
+
+void StageGraph::release(pass_t *pass, int n)
+{
+    if (--pass->holds_left[size_t(n)] > 0) {
+        return;
+    }
+    node_t &node = *nodes[size_t(n)];
+    bool ok = pass->ok[size_t(n)];
+    if (ok) {
+        StageContext ctx(pass->seq, pass->raw_index, pass->products.data(), node.inputs, n);
+        ok = node.stage->finish(ctx);
+    }
+    if (ok) {
+        node.processed++;
+    } else {
+        node.skipped++;
+    }
+    node.busy.store(false);
+
+    if (--pass->nodes_left == 0) {
+        pass->done();
+        delete pass;
+        in_flight--;
+    }
+}
+
+void StageGraph::skip(uint64_t frames)
+{
+    for (auto &node : nodes) {
+        node->skipped += frames;
+    }
+}
+
+void StageGraph::close()
+{
+    closed.store(true);
+    while (in_flight.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+std::vector<std::string> StageGraph::stageNames() const
+{
+    std::vector<std::string> names;
+    for (auto &node : nodes) {
+        names.push_back(node->name);
+    }
+    return names;
+}
+
+stage_stats_t StageGraph::stats(const std::string &name) const
+{
+    stage_stats_t stats = {0, 0};
+    for (auto &node : nodes) {
+        if (node->name == name) {
+            stats.processed = node->processed.load();
+            stats.skipped = node->skipped.load();
+        }
+    }
+    return stats;
+}
+
+void StageGraph::resetStats()
+{
+    for (auto &node : nodes) {
+        node->processed.store(0);
+        node->skipped.store(0);
+    }
+}
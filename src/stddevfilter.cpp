@@ -360,7 +360,6 @@ cl_program StdDevFilter::CreateProgram(const std::string &source, cl_context con
 
 void StdDevFilter::compute_stddev(LVFrame *new_frame, cl_uint new_N)
 {
-    static int count = 0;
     cl_event frame_written, hist_written, kernel_complete, frame_read, hist_read;
     if (new_N != N) {
         N = new_N;
@@ -393,7 +392,6 @@ void StdDevFilter::compute_stddev(LVFrame *new_frame, cl_uint new_N)
     if (currentN < N) {
         currentN++;
     }
-    count++;
     // wait for frame write completion
     CheckError(clWaitForEvents(2, end_wait_list), __LINE__);
 }
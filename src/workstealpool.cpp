@@ -0,0 +1,102 @@
+#include "workstealpool.h"
+#include "osutils.h"
+
+#include <QDebug>
+
+// Which pool the calling thread works for, and its deque there.
+static thread_local WorkStealingPool *current_pool = nullptr;
+static thread_local int current_queue = -1;
+
+WorkStealingPool::WorkStealingPool(int num_threads, const std::vector<int> &cpus)
+{
+    next_queue.store(0);
+    queued.store(0);
+    sleepers.store(0);
+    stopping.store(false);
+    num_threads = std::max(num_threads, 1);
+    for (int i = 0; i < num_threads; i++) {
+        queues.emplace_back(new queue_t);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i, cpus);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(park_lock);
+        stopping.store(true);
+        work_ready.notify_all();
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+    const int q = current_pool == this ? current_queue
+                                       : int(next_queue++ % unsigned(queues.size()));
+    {
+        std::lock_guard<std::mutex> lock(queues[size_t(q)]->lock);
+        queues[size_t(q)]->tasks.push_back(std::move(task));
+    }
+    // A worker about to sleep counts itself in sleepers before it looks at queued again, so
+    // either it sees this task or we see it and wake it up.
+    queued++;
+    if (sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(park_lock);
+        work_ready.notify_one();
+    }
+}
+
+bool WorkStealingPool::take(int self, std::function<void()> &task)
+{
+    const size_t n = queues.size();
+    {
+        queue_t &own = *queues[size_t(self)];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < n; i++) {
+        queue_t &victim = *queues[(size_t(self) + i) % n];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int self, std::vector<int> cpus)
+{
+    current_pool = this;
+    current_queue = self;
+    if (!cpus.empty() && !os::pinThread(cpus, nullptr)) {
+        qWarning("Unable to pin a processing thread to the CPUs configured for it.");
+    }
+
+    std::function<void()> task;
+    while (true) {
+        if (take(self, task)) {
+            queued--;
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(park_lock);
+        sleepers++;
+        work_ready.wait(lock, [&]() { return stopping.load() || queued.load() > 0; });
+        sleepers--;
+        if (stopping.load() && queued.load() == 0) {
+            break;
+        }
+    }
+}
@@ -1,11 +1,19 @@
 #include "xiocamera.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 XIOCamera::XIOCamera(int frWidth,
         int frHeight, int dataHeight,
+        int ioDepth, int readaheadMB,
         QObject *parent
-) : CameraModel(parent), nFrames(32), framesize(0),
-    //headsize(frWidth * int(sizeof(uint16_t))), image_no(0),
-	headsize(1280), image_no(0),
+) : CameraModel(parent), nFrames(32),
+    //headsize(frWidth * int(sizeof(uint16_t))),
+	headsize(1280), frSize(size_t(frWidth * dataHeight)),
+    frame_ring(size_t(2 * nFrames), frSize),
+    seek_pending(false), seek_target(0), indexed_files(0), read_dir(1), start_frame(0),
+    io_depth(std::max(1, ioDepth)), next_ticket(0), next_emit(0), next_file(0),
     tmoutPeriod(100) // milliseconds
 {
     source_type = XIO;
@@ -14,36 +22,70 @@ XIOCamera::XIOCamera(int frWidth,
     frame_height = frHeight;
     data_height = dataHeight;
     is_reading = false;
-    qDebug() << "rsv - headsize:" << headsize << " frWidth:" << frWidth << int(sizeof(uint16_t)) ;
 
-    header.resize(size_t(headsize));
-    std::fill(header.begin(), header.end(), 0);
+    // Keep at least one file per worker in flight, otherwise workers would sit idle.
+    const size_t fileBytes = size_t(nFrames) * frSize * sizeof(uint16_t);
+    max_files_ahead = std::max(size_t(io_depth), size_t(readaheadMB) * 1024 * 1024 / fileBytes);
+    qDebug() << "XIO read-ahead:" << io_depth << "readers," << max_files_ahead << "files in flight";
 
-    dummy.resize(size_t(frame_width * data_height));
+    dummy.resize(frSize);
     std::fill(dummy.begin(), dummy.end(), 0);
-    for (int n = 0; n < nFrames; n++) {
-        frame_buf.emplace_back(std::vector<uint16_t>(size_t(frame_width * data_height), 0));
-    }
+    temp_frame.resize(frSize);
+    slot_stamps.assign(frame_ring.capacity(), -1);
+    slot_frames.assign(frame_ring.capacity(), -1);
+    prev_mtime = -1;
+    last_stamp = -1;
+    no_data = true;
 }
 
 XIOCamera::~XIOCamera()
 {
     running.store(false);
     emit timeout();
-    is_reading = false;
-    readLoopFuture.waitForFinished();
+    stopReading();
 }
 
-void XIOCamera::setDir(const char *dirname)
+void XIOCamera::stopReading()
 {
     is_reading = false;
-    while (!frame_buf.empty()) {
-        frame_buf.pop_back();
+    frame_ring.close();
+    io_cv.notify_all();
+    for (auto &t : io_threads) {
+        t.join();
     }
-
+    io_threads.clear();
     if (readLoopFuture.isRunning()) {
         readLoopFuture.waitForFinished();
     }
+
+    std::lock_guard<std::mutex> lock(io_lock);
+    completed.clear();
+    next_ticket = 0;
+    next_emit = 0;
+    next_file = 0;
+    prev_mtime = -1;
+    frame_ring.reset();
+}
+
+void XIOCamera::startReading(int64_t first_frame)
+{
+    read_dir = play_dir.load();
+    start_frame = first_frame;
+    next_file = first_frame >= 0 ? first_frame / nFrames : -1;
+    is_reading = true;
+    for (int n = 0; n < io_depth; n++) {
+        io_threads.emplace_back(&XIOCamera::ioWorker, this);
+    }
+    readLoopFuture = QtConcurrent::run(this, &XIOCamera::readLoop);
+}
+
+void XIOCamera::setDir(const char *dirname)
+{
+    std::lock_guard<std::mutex> lease(lease_lock);
+    std::lock_guard<std::mutex> lock(control_lock);
+    stopReading();
+    seek_pending = false;
+    current_frame.store(-1);
     data_dir = dirname;
     if (data_dir.empty()) {
         if (running.load()) {
@@ -52,172 +94,301 @@ void XIOCamera::setDir(const char *dirname)
         }
         return;
     }
-    xio_files.clear();
-    dev_p.clear();
-    dev_p.close();
-    image_no = 0;
-    std::vector<std::string> fname_list;
-    os::listdir(fname_list, data_dir);
-
-    // Sort the frames in the product directory by filename, as mtime is unreliable.
-    std::sort(fname_list.begin(), fname_list.end(), doj::alphanum_less<std::string>());
-
-    for (auto &f : fname_list) {
-        std::string ext = os::getext(f);
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-        if (f.empty() or std::strcmp(ext.data(), "xio") != 0 or std::strcmp(ext.data(), "decomp") != 0)
-            continue;
-
-        xio_files.emplace_back(f);
-    }
+    xio_files.follow(data_dir);
+    indexed_files.store(int64_t(xio_files.size()));
 
     running.store(true);
     emit started();
 
-    is_reading = true;
-    readLoopFuture = QtConcurrent::run(this, &XIOCamera::readLoop);
+    startReading(play_dir.load() > 0 ? 0 : frameCount() - 1);
 }
 
-std::string XIOCamera::getFname()
+bool XIOCamera::seek(int64_t frame)
 {
-    std::string fname; // will return empty string if no unread files are found.
-    std::vector<std::string> fname_list;
-    bool has_file = false;
     if (data_dir.empty()) {
-        return fname;
+        return false;
     }
-    if (image_no < xio_files.size()) {
-        fname = xio_files[image_no++];
-    } else {
-        os::listdir(fname_list, data_dir);
-        if (fname_list.size() < 1) {
-            return fname;
-        }
-        /* if necessary, there may need to be code to sort the "frames" in the data directory
-        * by product name, as mtime is unreliable.
-        */
-        std::sort(fname_list.begin(), fname_list.end(), doj::alphanum_less<std::string>());
-        for (auto f = fname_list.end() - 1; f != fname_list.begin(); --f) {
-            has_file = std::find(xio_files.begin(), xio_files.end(), *f) != xio_files.end();
-            std::string ext = os::getext(*f);
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            if ((*f).empty() or (std::strcmp(ext.data(), "xio") != 0 and
-                                 std::strcmp(ext.data(), "decomp") != 0)) {
-                continue;
-            } else if (has_file) {
-                break;
-            } else {
-                xio_files.emplace_back(*f);
-            }
+    seek_target.store(std::max<int64_t>(frame, 0));
+    seek_pending.store(true);
+    return true;
+}
 
-        }
+void XIOCamera::setPlayDirection(int dir)
+{
+    const int old_dir = play_dir.load();
+    CameraModel::setPlayDirection(dir);
+    if (play_dir.load() != old_dir && !data_dir.empty()) {
+        // The frames queued up in the ring run the old way, so start over from the current frame.
+        const int64_t current = current_frame.load();
+        seek_target.store(current >= 0 ? current + play_dir.load() : 0);
+        seek_pending.store(true);
+    }
+}
 
-        if (image_no < xio_files.size()) {
-            fname = xio_files[image_no++];
-        }
+void XIOCamera::applySeek()
+{
+    std::lock_guard<std::mutex> lock(control_lock);
+    if (!seek_pending.exchange(false) || data_dir.empty()) {
+        return;
     }
+    stopReading();
+    startReading(seek_target.load());
+    if (!running.load()) {
+        running.store(true);
+        emit started();
+    }
+}
 
-    return fname;
+bool XIOCamera::takeFile(std::string &fname, int64_t &index)
+{
+    const int64_t loopFirst = std::max<int64_t>(loop_first.load(), 0);
+    const int64_t loopLast = loop_last.load();
+    if (loopFirst <= loopLast) {
+        const int64_t firstFile = loopFirst / nFrames;
+        const int64_t lastFile = loopLast / nFrames;
+        if (next_file < firstFile || next_file > lastFile) {
+            next_file = read_dir > 0 ? firstFile : lastFile;
+        }
+    }
+    if (next_file < 0 || !xio_files.at(size_t(next_file), fname)) {
+        return false;
+    }
+    indexed_files.store(int64_t(xio_files.size()));
+    index = next_file;
+    next_file += read_dir;
+    return true;
 }
 
-void XIOCamera::readFile()
+void XIOCamera::ioWorker()
 {
-    bool validFile = false;
-    while(!validFile) {
-        ifname = getFname();
-        if (ifname.empty()) {
-            if (dev_p.is_open()) {
-                dev_p.close();
+    while (is_reading) {
+        std::string fname;
+        uint64_t ticket;
+        int64_t index;
+        std::vector<uint16_t> buf;
+        int64_t mtime_ns = -1;
+        {
+            std::unique_lock<std::mutex> lock(io_lock);
+            io_cv.wait_for(lock, std::chrono::milliseconds(tmoutPeriod), [this]() {
+                return !is_reading || next_ticket - next_emit < max_files_ahead;
+            });
+            if (!is_reading || next_ticket - next_emit >= max_files_ahead) {
+                continue;
             }
-
-            if (running.load()) {
-                running.store(false);
-                emit timeout();
+            if (!takeFile(fname, index)) {
+                // Out of files for now, sleep until the directory changes. Played back past the
+                // first file there is nothing a new file could change, and as takeFile() did not
+                // look at the directory, its pending changes would keep waking us right away.
+                const bool before_first = next_file < 0;
+                lock.unlock();
+                if (before_first) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(tmoutPeriod));
+                } else {
+                    xio_files.wait(tmoutPeriod);
+                }
+                continue;
+            }
+            ticket = next_ticket++;
+            if (!spare_bufs.empty()) {
+                buf.swap(spare_bufs.back());
+                spare_bufs.pop_back();
             }
-            return; //If we're out of files, give up
-        }
-        // otherwise check if data is valid
-        dev_p.open(ifname, std::ios::in | std::ios::binary);
-        if (!dev_p.is_open()) {
-            qDebug() << "Could not open file" << ifname.data() << ". Does it exist?";
-            dev_p.clear();
-            readFile();
-            return;
         }
 
-        // qDebug() << "Successfully opened " << ifname.data();
-        dev_p.unsetf(std::ios::skipws);
-
-        dev_p.read(reinterpret_cast<char*>(header.data()), headsize);
-
-        std::streampos filesize(0);
-        std::string ext = os::getext(ifname);
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-        if (!std::strcmp(ext.data(), "decomp")) {
-            dev_p.seekg(0, std::ios::end);
-            filesize = dev_p.tellg();
-            dev_p.seekg(headsize, std::ios::beg);
-        } else {
-            // convert the raw hex string to decimal, one digit at a time.
-            filesize = int(header[7]) * 16777216 + int(header[6]) * 65536 + int(header[5]) * 256 + int(header[4]);
+        if (!loadFile(fname, buf, mtime_ns)) {
+            buf.clear(); // an empty buffer tells readLoop to skip this ticket
         }
 
-        framesize = static_cast<size_t>(filesize / nFrames);
-        if (framesize == 0) { //If header reports a 0 filesize (invalid data), then skip this file.
-            dev_p.close();
-            qDebug().nospace() << "Skipped file \"" << ifname.data() << "\" due to invalid data.";
-        } else { //otherwise we load it
-            validFile = true;
-            qDebug() << "rsv - dev_p.seekg()" << headsize  ;
-            dev_p.seekg(headsize, std::ios::beg);
+        {
+            std::lock_guard<std::mutex> lock(io_lock);
+            completed[ticket].frames.swap(buf);
+            completed[ticket].index = index;
+            completed[ticket].mtime_ns = mtime_ns;
+        }
+        io_cv.notify_all();
+    }
+}
 
-            // qDebug() << "File size is" << filesize << "bytes, which corresponds to a framesize of" << framesize << "bytes.";
+bool XIOCamera::loadFile(const std::string &fname, std::vector<uint16_t> &buf, int64_t &mtime_ns)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1) {
+        qDebug() << "Could not open file" << fname.data() << ". Does it exist?";
+        return false;
+    }
 
-            std::vector<uint16_t> zero_vec(size_t(frame_width * data_height) - (size_t(framesize) / sizeof(uint16_t)));
-            std::fill(zero_vec.begin(), zero_vec.end(), 0);
+    std::vector<unsigned char> header(size_t(headsize), 0);
+    if (pread(fd, header.data(), header.size(), 0) != ssize_t(header.size())) {
+        close(fd);
+        qDebug().nospace() << "Skipped file \"" << fname.data() << "\" due to a short header.";
+        return false;
+    }
 
-            std::vector<uint16_t> copy_vec(size_t(framesize), 0);
+    struct stat st = {};
+    fstat(fd, &st);
+#ifdef __APPLE__
+    mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + int64_t(st.st_mtimespec.tv_nsec);
+#else
+    mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + int64_t(st.st_mtim.tv_nsec);
+#endif
 
-            for (int n = 0; n < nFrames; ++n) {
-                dev_p.read(reinterpret_cast<char*>(copy_vec.data()), std::streamsize(framesize));
-                frame_buf.emplace_front(copy_vec);
+    size_t filesize = 0;
+    std::string ext = os::getext(fname);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (!std::strcmp(ext.data(), "decomp")) {
+        filesize = size_t(st.st_size);
+    } else {
+        // convert the raw hex string to decimal, one digit at a time.
+        filesize = size_t(header[7]) * 16777216 + size_t(header[6]) * 65536 + size_t(header[5]) * 256 + size_t(header[4]);
+    }
 
-                if (framesize / sizeof(uint16_t) < size_t(frame_width * data_height)) {
-                    std::copy(zero_vec.begin(), zero_vec.end(), frame_buf[size_t(n)].begin() + framesize / sizeof(uint16_t));
-                }
-            }
+    const size_t framesize = filesize / size_t(nFrames);
+    if (framesize == 0) { //If header reports a 0 filesize (invalid data), then skip this file.
+        close(fd);
+        qDebug().nospace() << "Skipped file \"" << fname.data() << "\" due to invalid data.";
+        return false;
+    }
 
-            running.store(true);
-            emit started();
-            dev_p.close();
+    // Frames are laid out at the configured geometry. Short frames are zero padded, and anything
+    // beyond the geometry is skipped.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    buf.resize(size_t(nFrames) * frSize);
+    const size_t slotBytes = frSize * sizeof(uint16_t);
+    const size_t readBytes = std::min(framesize, slotBytes);
+    char *dst = reinterpret_cast<char*>(buf.data());
+    for (int n = 0; n < nFrames; n++) {
+        ssize_t got = pread(fd, dst + size_t(n) * slotBytes, readBytes,
+                            off_t(size_t(headsize) + size_t(n) * framesize));
+        size_t valid = got > 0 ? size_t(got) : 0;
+        if (valid < slotBytes) {
+            memset(dst + size_t(n) * slotBytes + valid, 0, slotBytes - valid);
         }
     }
+    close(fd);
+    return true;
 }
 
 void XIOCamera::readLoop()
 {
-    QTime remTime;
-    do {
-        // Yeah yeah whatever it's a magic buffer size recommendation
-        if (frame_buf.size() <= 96) {
-            readFile();
-        } else {
-            remTime = QTime::currentTime().addMSecs(tmoutPeriod);
-            while(QTime::currentTime() < remTime) {
-                QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    while (is_reading) {
+        std::vector<uint16_t> buf;
+        int64_t index = 0;
+        int64_t mtime_ns = -1;
+        {
+            std::unique_lock<std::mutex> lock(io_lock);
+            bool ready = io_cv.wait_for(lock, std::chrono::milliseconds(tmoutPeriod), [this]() {
+                return !is_reading || completed.count(next_emit) > 0;
+            });
+            if (!is_reading) {
+                break;
             }
+            if (!ready) {
+                // Nothing loaded and nothing loading means we have played everything there is.
+                if (next_ticket == next_emit && frame_ring.empty() && running.load()) {
+                    running.store(false);
+                    emit timeout();
+                }
+                continue;
+            }
+            buf.swap(completed[next_emit].frames);
+            index = completed[next_emit].index;
+            mtime_ns = completed[next_emit].mtime_ns;
+            completed.erase(next_emit);
         }
-    } while (is_reading);
+
+        if (!buf.empty()) {
+            if (!running.load()) {
+                running.store(true);
+                emit started();
+            }
+            const bool stamped = prev_mtime >= 0 && mtime_ns > prev_mtime;
+            const int64_t spacing = stamped ? (mtime_ns - prev_mtime) / nFrames : 0;
+            const int64_t loopFirst = std::max<int64_t>(loop_first.load(), 0);
+            const int64_t loopLast = loop_last.load();
+            for (int k = 0; k < nFrames && is_reading; k++) {
+                const int n = read_dir > 0 ? k : nFrames - 1 - k;
+                const int64_t frame_no = index * nFrames + n;
+                // Skip the part of the first file that lies before the seek target, and anything outside the loop.
+                if (read_dir > 0 ? frame_no < start_frame : frame_no > start_frame) {
+                    continue;
+                }
+                if (loopFirst <= loopLast && (frame_no < loopFirst || frame_no > loopLast)) {
+                    continue;
+                }
+                uint16_t *slot = nullptr;
+                while (is_reading && !(slot = frame_ring.beginWrite(tmoutPeriod))) {}
+                if (!slot) {
+                    break;
+                }
+                memcpy(slot, buf.data() + size_t(n) * frSize, frSize * sizeof(uint16_t));
+                slot_stamps[frame_ring.slotIndex(slot)] = stamped ? prev_mtime + n * spacing : -1;
+                slot_frames[frame_ring.slotIndex(slot)] = frame_no;
+                frame_ring.commitWrite();
+            }
+            // Only the first file is trimmed, a loop may well come back around to earlier frames.
+            start_frame = read_dir > 0 ? 0 : INT64_MAX;
+            prev_mtime = mtime_ns;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(io_lock);
+            next_emit++;
+            if (!buf.empty()) {
+                spare_bufs.push_back(std::vector<uint16_t>());
+                spare_bufs.back().swap(buf);
+            }
+        }
+        io_cv.notify_all();
+    }
 }
 
 uint16_t* XIOCamera::getFrame()
 {
-    if (!frame_buf.empty() && is_reading) {
-        temp_frame = frame_buf.back();
-        // prev_frame = &temp_frame;
-        frame_buf.pop_back();
-        return temp_frame.data();
-    } else {
+    std::lock_guard<std::mutex> lease(lease_lock);
+    applySeek();
+    uint16_t *frame = frame_ring.beginRead(0);
+    if (frame && !is_reading) {
+        frame_ring.endRead();
+        frame = nullptr;
+    }
+    no_data = !frame;
+    if (no_data) {
+        last_stamp = -1;
         return dummy.data();
     }
+    last_stamp = slot_stamps[frame_ring.slotIndex(frame)];
+    current_frame.store(slot_frames[frame_ring.slotIndex(frame)]);
+    std::copy(frame, frame + frame_ring.frameSize(), temp_frame.begin());
+    frame_ring.endRead();
+    return temp_frame.data();
+}
+
+uint16_t* XIOCamera::acquireFrame(uint16_t *slot)
+{
+    Q_UNUSED(slot);
+    lease_lock.lock();
+    // After a seek, give the readers a moment so that stepping through frames doesn't show a blank one.
+    int wait_ms = 0;
+    if (seek_pending.load()) {
+        applySeek();
+        wait_ms = 10 * tmoutPeriod;
+    }
+    // Lend out the ring slot itself, it is handed back to the reader in releaseFrame().
+    uint16_t *frame = frame_ring.beginRead(wait_ms);
+    no_data = !frame;
+    if (!frame) {
+        last_stamp = -1;
+        return dummy.data();
+    }
+    last_stamp = slot_stamps[frame_ring.slotIndex(frame)];
+    current_frame.store(slot_frames[frame_ring.slotIndex(frame)]);
+    return frame;
+}
+
+void XIOCamera::releaseFrame(uint16_t *frame)
+{
+    if (frame != dummy.data()) {
+        frame_ring.endRead();
+    }
+    lease_lock.unlock();
 }
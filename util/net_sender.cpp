@@ -0,0 +1,142 @@
+/* Minimal sender for LiveView's network stream source, for trying out the "Network
+ * Stream" camera model over loopback, and as a starting point for acquisition nodes
+ * that want to feed a LiveView display station. Sends a moving ramp.
+ *
+ * Build: g++ -O2 -std=c++11 -I../include net_sender.cpp -o net_sender
+ * Usage: net_sender [udp|tcp] [host=127.0.0.1] [port=50010] [width=640] [height=480]
+ *                   [fps=100] [udp payload bytes=8192] [udp loss %=0]
+ *
+ * Start LiveView first with the same geometry, protocol and port (net_protocol, net_port). */
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netframe.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+    stop = 1;
+}
+
+static bool send_all(int fd, const void *buf, size_t len)
+{
+    auto ptr = static_cast<const char*>(buf);
+    while (len) {
+        ssize_t sent = send(fd, ptr, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        ptr += sent;
+        len -= size_t(sent);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool tcp = argc > 1 && std::string(argv[1]) == "tcp";
+    const char *host = argc > 2 ? argv[2] : "127.0.0.1";
+    const int port = argc > 3 ? atoi(argv[3]) : 50010;
+    const uint32_t width = argc > 4 ? uint32_t(atoi(argv[4])) : 640;
+    const uint32_t height = argc > 5 ? uint32_t(atoi(argv[5])) : 480;
+    const double fps = argc > 6 ? atof(argv[6]) : 100.0;
+    const size_t payload = argc > 7 ? size_t(atoi(argv[7])) : 8192;
+    const double loss = argc > 8 ? atof(argv[8]) / 100.0 : 0.0;
+    if (!width || !height || !payload || payload > netframe::MAX_DATAGRAM - sizeof(netframe::fragment_header_t)) {
+        fprintf(stderr, "bad geometry or payload size\n");
+        return 1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", host);
+        return 1;
+    }
+    int fd = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd == -1 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        perror("connect");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    const size_t frame_bytes = size_t(width) * height * sizeof(uint16_t);
+    const uint32_t frags = netframe::fragmentCount(frame_bytes, payload);
+    if (!tcp && frags > 65535) {
+        fprintf(stderr, "frames need more than 65535 fragments, use a larger payload\n");
+        return 1;
+    }
+    printf("Sending %ux%u frames at %.1f fps to %s:%d over %s", width, height, fps, host, port, tcp ? "TCP" : "UDP");
+    if (!tcp) {
+        printf(" (%u fragments of %zu bytes, %.1f%% dropped)", frags, payload, loss * 100.0);
+    }
+    printf("\n");
+
+    std::vector<uint16_t> frame(size_t(width) * height);
+    std::vector<unsigned char> datagram(sizeof(netframe::fragment_header_t) + payload);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    using namespace std::chrono;
+    const auto period = duration_cast<steady_clock::duration>(duration<double>(fps > 0 ? 1.0 / fps : 0.0));
+    auto deadline = steady_clock::now();
+    for (uint64_t seq = 1; !stop; seq++) {
+        for (uint32_t r = 0; r < height; r++) {
+            for (uint32_t c = 0; c < width; c++) {
+                frame[size_t(r) * width + c] = uint16_t((c + r + seq * 4) * 16);
+            }
+        }
+        const int64_t stamp = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+
+        if (tcp) {
+            netframe::frame_header_t hdr = { netframe::MAGIC, netframe::VERSION, seq, stamp,
+                                             width, height, frame_bytes };
+            if (!send_all(fd, &hdr, sizeof(hdr)) || !send_all(fd, frame.data(), frame_bytes)) {
+                perror("send");
+                break;
+            }
+        } else {
+            for (uint32_t f = 0; f < frags; f++) {
+                const size_t offset = f * payload;
+                const size_t len = std::min(payload, frame_bytes - offset);
+                netframe::fragment_header_t hdr = { netframe::MAGIC, uint32_t(frame_bytes), seq, stamp,
+                                                    uint32_t(offset), uint16_t(f), uint16_t(frags) };
+                memcpy(datagram.data(), &hdr, sizeof(hdr));
+                memcpy(datagram.data() + sizeof(hdr), reinterpret_cast<unsigned char*>(frame.data()) + offset, len);
+                if (loss > 0 && coin(rng) < loss) {
+                    continue;
+                }
+                // Nobody listening yet gives ECONNREFUSED on a connected UDP socket, just keep going.
+                send(fd, datagram.data(), sizeof(hdr) + len, 0);
+            }
+        }
+        if (seq % 1000 == 0) {
+            printf("%llu frames\n", static_cast<unsigned long long>(seq));
+            fflush(stdout);
+        }
+        deadline += period;
+        std::this_thread::sleep_until(deadline);
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/* Minimal producer for LiveView's shared-memory ring source, for trying out the
+ * "Shared Memory" camera model without an instrument, and as a starting point for
+ * acquisition programs that want to feed LiveView. Writes a moving ramp.
+ *
+ * Build: g++ -O2 -std=c++11 -I../include shm_producer.cpp -o shm_producer -lrt
+ * Usage: shm_producer [name=/liveview_ring] [width=640] [height=480] [fps=100] [slots=64]
+ *
+ * Start this first, then LiveView with the same name in the shm_name setting. */
+
+#include <stdint.h>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shmring.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+    stop = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string name = argc > 1 ? argv[1] : "/liveview_ring";
+    const uint32_t width = argc > 2 ? uint32_t(atoi(argv[2])) : 640;
+    const uint32_t height = argc > 3 ? uint32_t(atoi(argv[3])) : 480;
+    const double fps = argc > 4 ? atof(argv[4]) : 100.0;
+    const uint32_t slots = argc > 5 ? uint32_t(atoi(argv[5])) : 64;
+    if (!width || !height || !slots) {
+        fprintf(stderr, "width, height and slots must be positive\n");
+        return 1;
+    }
+
+    // Build the header privately first to learn the segment size.
+    shmring::header_t layout;
+    layout.num_slots = slots;
+    layout.slot_stride = shmring::slotStride(width, height);
+    layout.data_offset = shmring::dataOffset();
+    const size_t size = size_t(shmring::segmentSize(&layout));
+
+    // Always start from a fresh segment, readers notice the new one and reattach.
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd == -1 || ftruncate(fd, off_t(size)) == -1) {
+        perror("shm_open");
+        return 1;
+    }
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    auto hdr = static_cast<shmring::header_t*>(map);
+    shmring::init(hdr, width, height, height, slots);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("Writing %ux%u frames at %.1f fps into %s (%u slots, %zu bytes)\n",
+           width, height, fps, name.c_str(), slots, size);
+
+    using namespace std::chrono;
+    const auto period = duration_cast<steady_clock::duration>(duration<double>(fps > 0 ? 1.0 / fps : 0.0));
+    auto deadline = steady_clock::now();
+    for (uint64_t seq = 1; !stop; seq++) {
+        uint16_t *frame = shmring::beginWrite(hdr, seq);
+        for (uint32_t r = 0; r < height; r++) {
+            for (uint32_t c = 0; c < width; c++) {
+                frame[size_t(r) * width + c] = uint16_t((c + r + seq * 4) * 16);
+            }
+        }
+        shmring::commitWrite(hdr, seq,
+                             duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+        if (seq % 1000 == 0) {
+            printf("%llu frames\n", static_cast<unsigned long long>(seq));
+            fflush(stdout);
+        }
+        deadline += period;
+        std::this_thread::sleep_until(deadline);
+    }
+
+    munmap(map, size);
+    shm_unlink(name.c_str());
+    return 0;
+}